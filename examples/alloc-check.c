@@ -0,0 +1,212 @@
+// checks that tinyfx doesn't allocate once frames reach a steady state, with
+// and without a render thread. only tinyfx's own calls are counted, drivers
+// may allocate as they please. exits non-zero if anything was allocated.
+// build with: make alloc-check
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+static int g_counting = 0;
+static uint32_t g_allocs = 0;
+
+static void count_alloc() {
+	if (__atomic_load_n(&g_counting, __ATOMIC_ACQUIRE)) {
+		__atomic_add_fetch(&g_allocs, 1, __ATOMIC_RELAXED);
+	}
+}
+
+static void *count_malloc(size_t size) {
+	count_alloc();
+	return malloc(size);
+}
+
+static void *count_calloc(size_t count, size_t size) {
+	count_alloc();
+	return calloc(count, size);
+}
+
+static void *count_realloc(void *ptr, size_t size) {
+	count_alloc();
+	return realloc(ptr, size);
+}
+
+#define malloc count_malloc
+#define calloc count_calloc
+#define realloc count_realloc
+#include "../tinyfx.c"
+#undef malloc
+#undef calloc
+#undef realloc
+
+#include <SDL2/SDL.h>
+
+#define WARMUP_FRAMES 30
+#define CHECKED_FRAMES 300
+
+static struct {
+	tfx_program prog;
+	tfx_uniform color;
+	tfx_uniform tex;
+	tfx_vertex_format fmt;
+	tfx_buffer vbo;
+	tfx_buffer dynamic;
+	tfx_texture pixels;
+	uint32_t pixel_data[16*16];
+	int frames;
+} check;
+
+static void check_init() {
+	const char *vss = ""
+		"in vec3 a_position;\n"
+		"void main() {\n"
+		"	gl_Position = vec4(a_position.xyz, 1.0);\n"
+		"}\n"
+	;
+	const char *fss = ""
+		"precision mediump float;\n"
+		"uniform vec4 u_color;\n"
+		"uniform sampler2D s_tex;\n"
+		"out vec4 out_color;\n"
+		"void main() {\n"
+		"	out_color = u_color * texture(s_tex, vec2(0.5));\n"
+		"}\n"
+	;
+	const char *attribs[] = { "a_position", NULL };
+	check.prog = tfx_program_new(vss, fss, attribs, -1);
+	check.color = tfx_uniform_new("u_color", TFX_UNIFORM_VEC4, 1);
+	check.tex = tfx_uniform_new("s_tex", TFX_UNIFORM_INT, 1);
+
+	check.fmt = tfx_vertex_format_start();
+	tfx_vertex_format_add(&check.fmt, 0, 3, false, TFX_TYPE_FLOAT);
+	tfx_vertex_format_end(&check.fmt);
+
+	float verts[] = {
+		 0.0f,  0.5f, 0.0f,
+		-0.5f, -0.5f, 0.0f,
+		 0.5f, -0.5f, 0.0f
+	};
+	check.vbo = tfx_buffer_new(verts, sizeof(verts), &check.fmt, TFX_BUFFER_NONE);
+	check.dynamic = tfx_buffer_new(NULL, sizeof(verts), &check.fmt, TFX_BUFFER_MUTABLE);
+	check.pixels = tfx_texture_new(16, 16, 1, NULL, TFX_FORMAT_RGBA8, TFX_TEXTURE_CPU_WRITABLE);
+
+	tfx_view_set_clear_color(0, 0x555555ff);
+	tfx_view_set_name(0, "Alloc Check");
+	check.frames = 0;
+}
+
+static void check_deinit() {
+	tfx_buffer_free(&check.vbo);
+	tfx_buffer_free(&check.dynamic);
+	tfx_texture_free(&check.pixels);
+}
+
+// records one frame, the same work every time.
+static void check_frame() {
+	float verts[] = {
+		 0.0f,  0.5f, 0.0f,
+		-0.5f, -0.5f, 0.0f,
+		 0.5f, -0.5f, 0.0f
+	};
+	tfx_buffer_update(&check.dynamic, verts, 0, sizeof(verts));
+	check.pixel_data[check.frames % 256] = 0xffffffff;
+	tfx_texture_update(&check.pixels, check.pixel_data);
+
+	for (int i = 0; i < 64; i++) {
+		float color[] = { (float)(i % 4) / 4.0f, 1.0f, 1.0f, 1.0f };
+		tfx_set_uniform(&check.color, color, 1);
+		tfx_set_texture(&check.tex, &check.pixels, 0);
+		if (i % 3 == 0) {
+			tfx_transient_buffer tb = tfx_transient_buffer_new(&check.fmt, 3);
+			memcpy(tb.data, verts, sizeof(verts));
+			tfx_set_transient_buffer(tb);
+		}
+		else {
+			tfx_set_vertices(i % 3 == 1 ? &check.vbo : &check.dynamic, 3);
+		}
+		tfx_set_state(TFX_STATE_RGB_WRITE | TFX_STATE_ALPHA_WRITE);
+		tfx_submit(0, check.prog, false);
+	}
+
+	check.frames += 1;
+	if (check.frames == WARMUP_FRAMES) {
+		__atomic_store_n(&g_counting, 1, __ATOMIC_RELEASE);
+	}
+	tfx_frame();
+	if (check.frames == WARMUP_FRAMES + CHECKED_FRAMES) {
+		__atomic_store_n(&g_counting, 0, __ATOMIC_RELEASE);
+	}
+}
+
+static void *check_app_thread(void *arg) {
+	(void)arg;
+	for (int i = 0; i < WARMUP_FRAMES + CHECKED_FRAMES; i++) {
+		check_frame();
+	}
+	tfx_render_stop();
+	return NULL;
+}
+
+static bool check_run(SDL_Window *window, bool render_thread) {
+	__atomic_store_n(&g_allocs, 0, __ATOMIC_RELAXED);
+
+	tfx_reset(640, 480, render_thread ? TFX_RESET_RENDER_THREAD : TFX_RESET_NONE);
+	check_init();
+
+	if (render_thread) {
+		pthread_t app;
+		pthread_create(&app, NULL, check_app_thread, NULL);
+		while (tfx_render_frame()) {
+			SDL_GL_SwapWindow(window);
+		}
+		pthread_join(app, NULL);
+	}
+	else {
+		for (int i = 0; i < WARMUP_FRAMES + CHECKED_FRAMES; i++) {
+			check_frame();
+			SDL_GL_SwapWindow(window);
+		}
+	}
+
+	check_deinit();
+	tfx_shutdown();
+
+	uint32_t allocs = __atomic_load_n(&g_allocs, __ATOMIC_RELAXED);
+	printf("%s: %u allocations in %d frames\n", render_thread ? "render thread" : "single thread", allocs, CHECKED_FRAMES);
+	return allocs == 0;
+}
+
+int main(int argc, char **argv) {
+	(void)argc;
+	(void)argv;
+
+	SDL_Init(SDL_INIT_VIDEO);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_ES);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
+	SDL_Window *window = SDL_CreateWindow(
+		"",
+		SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+		640, 480,
+		SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN
+	);
+	SDL_GLContext context = SDL_GL_CreateContext(window);
+	SDL_GL_MakeCurrent(window, context);
+
+	tfx_platform_data pd;
+	memset(&pd, 0, sizeof(tfx_platform_data));
+	pd.use_gles = true;
+	pd.context_version = 31;
+	pd.gl_get_proc_address = SDL_GL_GetProcAddress;
+	tfx_set_platform_data(pd);
+
+	bool ok = check_run(window, false);
+	ok = check_run(window, true) && ok;
+
+	SDL_GL_DeleteContext(context);
+	SDL_DestroyWindow(window);
+	SDL_Quit();
+
+	return ok ? 0 : 1;
+}
@@ -62,6 +62,9 @@ pub const VertexFormat = struct {
     pub inline fn end(self: *VertexFormat) void {
         raw.tfx_vertex_format_end(&self.format);
     }
+    pub inline fn setDivisor(self: *VertexFormat, divisor: u8) void {
+        raw.tfx_vertex_format_set_divisor(&self.format, divisor);
+    }
 };
 pub const Buffer = raw.tfx_buffer;
 pub fn TransientBuffer(t: var) type {
@@ -75,6 +78,14 @@ pub fn TransientBuffer(t: var) type {
                 .ptr = @ptrCast([*]align(1) t, tb.data),
             };
         }
+        // t should be u16 or u32
+        pub fn createIndices(count: u32) TransientBuffer(t) {
+            var tb = raw.tfx_transient_indices_new(count, t == u32);
+            return TransientBuffer(t){
+                .handle = tb,
+                .ptr = @ptrCast([*]align(1) t, tb.data),
+            };
+        }
     };
 }
 // var tb = tfx.TransientBuffer(f32).create(&fmt, 3);
@@ -92,6 +103,8 @@ pub const ResetFlags = struct {
     pub const DebugOverlay = raw.TFX_RESET_DEBUG_OVERLAY;
     pub const DebugOverlayStats = raw.TFX_RESET_DEBUG_OVERLAY_STATS;
     pub const ReportGPUTimings = raw.TFX_RESET_REPORT_GPU_TIMINGS;
+    pub const RenderThread = raw.TFX_RESET_RENDER_THREAD;
+    pub const UniformBuffers = raw.TFX_RESET_UNIFORM_BUFFERS;
 };
 pub const State = struct {
     pub const Default = raw.TFX_STATE_DEFAULT;
@@ -145,6 +158,9 @@ pub const ViewFlags = struct {
     pub const Invalidate = raw.TFX_VIEW_INVALIDATE;
     pub const Flush = raw.TFX_VIEW_FLUSH;
     pub const SortSequential = raw.TFX_VIEW_SORT_SEQUENTIAL;
+    pub const SortState = raw.TFX_VIEW_SORT_STATE;
+    pub const SortFrontToBack = raw.TFX_VIEW_SORT_FRONT_TO_BACK;
+    pub const SortBackToFront = raw.TFX_VIEW_SORT_BACK_TO_FRONT;
     pub const Default = raw.TFX_VIEW_DEFAULT;
 };
 pub const View = struct {
@@ -177,9 +193,14 @@ pub inline fn reset(w: u32, h: u32, flags: c_int) void {
 }
 pub const shutdown = raw.tfx_shutdown;
 pub const setBuffer = raw.tfx_set_buffer;
+pub const setInstances = raw.tfx_set_instances;
+pub const setInstanceBuffer = raw.tfx_set_instance_buffer;
 pub inline fn setTransientBuffer(tb: var) void {
     raw.tfx_set_transient_buffer(tb.handle);
 }
+pub inline fn setTransientIndices(tb: var) void {
+    raw.tfx_set_transient_indices(tb.handle);
+}
 pub inline fn setTexture(uniform: *Uniform, tex: *raw.tfx_texture, slot: u8) void {
     raw.tfx_set_texture(&uniform.handle, tex, slot);
 }
@@ -191,12 +212,74 @@ pub inline fn setUniform(uniform: *Uniform, data: [*]f32, count: i32) void {
 pub inline fn submit(view: View, program: Program, retain: bool) void {
     return raw.tfx_submit(view.id, program.handle, retain);
 }
+pub inline fn submitOrdered(view: View, program: Program, depth: u32, retain: bool) void {
+    return raw.tfx_submit_ordered(view.id, program.handle, depth, retain);
+}
 pub inline fn touch(view: View) void {
     return raw.tfx_touch(view.id);
 }
+pub inline fn submitBundle(view: View, bundle: *raw.tfx_bundle) void {
+    return raw.tfx_submit_bundle(view.id, bundle);
+}
+pub inline fn submitIndirect(view: View, program: Program, args: *Buffer, offset: u32, count: u32) void {
+    return raw.tfx_submit_indirect(view.id, program.handle, args, offset, count);
+}
+pub inline fn dispatchIndirect(view: View, program: Program, args: *Buffer, offset: u32) void {
+    return raw.tfx_dispatch_indirect(view.id, program.handle, args, offset);
+}
+pub const Encoder = struct {
+    handle: *raw.tfx_encoder,
+    pub inline fn begin(slot: u8) Encoder {
+        return .{ .handle = raw.tfx_encoder_begin(slot).? };
+    }
+    pub inline fn end(self: *const Encoder) void {
+        raw.tfx_encoder_end(self.handle);
+    }
+    pub inline fn setTransientBuffer(self: *const Encoder, tb: var) void {
+        raw.tfx_encoder_set_transient_buffer(self.handle, tb.handle);
+    }
+    pub inline fn setTransientIndices(self: *const Encoder, tb: var) void {
+        raw.tfx_encoder_set_transient_indices(self.handle, tb.handle);
+    }
+    pub inline fn setTexture(self: *const Encoder, uniform: *Uniform, tex: *raw.tfx_texture, slot: u8) void {
+        raw.tfx_encoder_set_texture(self.handle, &uniform.handle, tex, slot);
+    }
+    pub inline fn setInstances(self: *const Encoder, count: i32) void {
+        raw.tfx_encoder_set_instances(self.handle, @intCast(c_int, count));
+    }
+    pub inline fn setInstanceBuffer(self: *const Encoder, buf: *Buffer) void {
+        raw.tfx_encoder_set_instance_buffer(self.handle, buf);
+    }
+    pub inline fn setState(self: *const Encoder, flags: u64) void {
+        raw.tfx_encoder_set_state(self.handle, flags);
+    }
+    pub inline fn setUniform(self: *const Encoder, uniform: *Uniform, data: [*]f32, count: i32) void {
+        raw.tfx_encoder_set_uniform(self.handle, &uniform.handle, data, @intCast(c_int, count));
+    }
+    pub inline fn submit(self: *const Encoder, view: View, program: Program, retain: bool) void {
+        raw.tfx_encoder_submit(self.handle, view.id, program.handle, retain);
+    }
+    pub inline fn submitOrdered(self: *const Encoder, view: View, program: Program, depth: u32, retain: bool) void {
+        raw.tfx_encoder_submit_ordered(self.handle, view.id, program.handle, depth, retain);
+    }
+    pub inline fn touch(self: *const Encoder, view: View) void {
+        raw.tfx_encoder_touch(self.handle, view.id);
+    }
+    pub inline fn submitBundle(self: *const Encoder, view: View, bundle: *raw.tfx_bundle) void {
+        raw.tfx_encoder_submit_bundle(self.handle, view.id, bundle);
+    }
+    pub inline fn submitIndirect(self: *const Encoder, view: View, program: Program, args: *Buffer, offset: u32, count: u32) void {
+        raw.tfx_encoder_submit_indirect(self.handle, view.id, program.handle, args, offset, count);
+    }
+    pub inline fn dispatchIndirect(self: *const Encoder, view: View, program: Program, args: *Buffer, offset: u32) void {
+        raw.tfx_encoder_dispatch_indirect(self.handle, view.id, program.handle, args, offset);
+    }
+};
 pub inline fn getView(viewid: u8) View {
     return .{ .id = viewid };
 }
 pub inline fn frame() raw.tfx_stats {
     return raw.tfx_frame();
 }
+pub const renderFrame = raw.tfx_render_frame;
+pub const renderStop = raw.tfx_render_stop;
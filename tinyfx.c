@@ -19,6 +19,14 @@
 extern "C" {
 #endif
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
 // TODO: look into just keeping the stuff from GL header in here, this thing
 // isn't included on many systems and is kind of annoying to always need.
 #include <GL/glcorearb.h>
@@ -51,12 +59,128 @@ extern "C" {
 
 #ifndef TFX_UNIFORM_BUFFER_SIZE
 // by default, allow up to 4MB of uniform updates per frame.
-#define TFX_UNIFORM_BUFFER_SIZE 1024*1024*4
+#define TFX_UNIFORM_BUFFER_SIZE (1024*1024*4)
 #endif
 
 #ifndef TFX_TRANSIENT_BUFFER_SIZE
 // by default, allow up to 4MB of transient buffer data per frame.
-#define TFX_TRANSIENT_BUFFER_SIZE 1024*1024*4
+#define TFX_TRANSIENT_BUFFER_SIZE (1024*1024*4)
+#endif
+
+#ifndef TFX_TRANSIENT_INDEX_BUFFER_SIZE
+// by default, allow up to 1MB of transient indices per frame.
+#define TFX_TRANSIENT_INDEX_BUFFER_SIZE (1024*1024*1)
+#endif
+
+#ifndef TFX_TRANSIENT_CHUNK_MAX
+// frames needing more transient data than the sizes above chain on extra
+// buffers of the same size, up to this many in total.
+#define TFX_TRANSIENT_CHUNK_MAX 4
+#endif
+
+#ifndef TFX_UNIFORM_RING_SIZE
+// with TFX_RESET_UNIFORM_BUFFERS, allow up to 2MB of uniform blocks per frame.
+// the ring holds TFX_UNIFORM_RING_FRAMES of these, so frames in flight aren't stomped.
+#define TFX_UNIFORM_RING_SIZE (1024*1024*2)
+#endif
+
+#ifndef TFX_UNIFORM_RING_FRAMES
+#define TFX_UNIFORM_RING_FRAMES 3
+#endif
+
+#ifndef TFX_BUFFER_HEAP_BLOCK_SIZE
+// buffers created with TFX_BUFFER_SUBALLOCATE share GL buffers of this size.
+#define TFX_BUFFER_HEAP_BLOCK_SIZE (1024*1024*32)
+#endif
+
+#ifndef TFX_UPLOAD_BUDGET_BYTES
+// queued uploads issued per frame, 0 for no limit. see tfx_set_upload_budget.
+#define TFX_UPLOAD_BUDGET_BYTES (1024*1024*8)
+#endif
+
+#ifndef TFX_UPLOAD_BUDGET_USEC
+#define TFX_UPLOAD_BUDGET_USEC 2000
+#endif
+
+#ifndef TFX_ENCODER_MAX
+// number of slots available to tfx_encoder_begin.
+#define TFX_ENCODER_MAX 16
+#endif
+
+#ifndef TFX_UNIFORM_CHUNK_SIZE
+// encoders stage uniform data in chunks of this size, allocated as needed.
+// this is also the largest single uniform update allowed.
+#define TFX_UNIFORM_CHUNK_SIZE (1024*256)
+#endif
+
+// minimal semaphore for handing frames to the render thread.
+#ifdef _WIN32
+typedef HANDLE tfx_sem;
+static void tfx_sem_init(tfx_sem *s, int count) { *s = CreateSemaphore(NULL, count, 0x7fffffff, NULL); }
+static void tfx_sem_free(tfx_sem *s) { CloseHandle(*s); }
+static void tfx_sem_post(tfx_sem *s) { ReleaseSemaphore(*s, 1, NULL); }
+static void tfx_sem_wait(tfx_sem *s) { WaitForSingleObject(*s, INFINITE); }
+#else
+typedef struct tfx_sem {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int count;
+} tfx_sem;
+static void tfx_sem_init(tfx_sem *s, int count) {
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->cond, NULL);
+	s->count = count;
+}
+static void tfx_sem_free(tfx_sem *s) {
+	pthread_cond_destroy(&s->cond);
+	pthread_mutex_destroy(&s->lock);
+}
+static void tfx_sem_post(tfx_sem *s) {
+	pthread_mutex_lock(&s->lock);
+	s->count += 1;
+	pthread_cond_signal(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+}
+static void tfx_sem_wait(tfx_sem *s) {
+	pthread_mutex_lock(&s->lock);
+	while (s->count == 0) {
+		pthread_cond_wait(&s->cond, &s->lock);
+	}
+	s->count -= 1;
+	pthread_mutex_unlock(&s->lock);
+}
+#endif
+
+// monotonic clock in microseconds, for time budgets.
+static uint64_t tfx_usec() {
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000 + (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+#endif
+}
+
+// relaxed atomic add, returns the previous value.
+// compare and swaps return true if the value was swapped.
+// stores release, so whatever was written before them is visible first.
+#ifdef _MSC_VER
+#include <intrin.h>
+#define tfx_atomic_add(ptr, v) ((uint32_t)_InterlockedExchangeAdd((volatile long*)(ptr), (long)(v)))
+#define tfx_atomic_cas(ptr, expected, desired) ((uint32_t)_InterlockedCompareExchange((volatile long*)(ptr), (long)(desired), (long)(expected)) == (expected))
+#define tfx_atomic_cas_ptr(ptr, expected, desired) (_InterlockedCompareExchangePointer((void* volatile*)(ptr), (desired), (expected)) == (expected))
+#define tfx_atomic_load_ptr(ptr) _InterlockedCompareExchangePointer((void* volatile*)(ptr), NULL, NULL)
+#define tfx_atomic_store(ptr, v) _InterlockedExchange((volatile long*)(ptr), (long)(v))
+#else
+#define tfx_atomic_add(ptr, v) __atomic_fetch_add((ptr), (v), __ATOMIC_RELAXED)
+#define tfx_atomic_cas(ptr, expected, desired) __sync_bool_compare_and_swap((ptr), (expected), (desired))
+#define tfx_atomic_cas_ptr(ptr, expected, desired) __sync_bool_compare_and_swap((ptr), (expected), (desired))
+#define tfx_atomic_load_ptr(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define tfx_atomic_store(ptr, v) __atomic_store_n((ptr), (v), __ATOMIC_RELEASE)
 #endif
 
 // The following code is public domain, from https://github.com/nothings/stb
@@ -121,6 +245,9 @@ static void * stb__sbgrowf(void *arr, int increment, int itemsize)
 #endif // STB_STRETCHY_BUFFER_H_INCLUDED
 //////////////////////////////////////////////////////////////////////////////
 
+// empty a stretchy buffer but keep its memory, so steady state frames don't allocate.
+#define sb_clear(a) ((a) ? (stb__sbn(a) = 0) : 0)
+
 static char *tfx_strdup(const char *src) {
 	size_t len = strlen(src) + 1;
 	char *s = malloc(len);
@@ -166,7 +293,12 @@ enum {
 
 	TFXI_VIEW_INVALIDATE      = 1 << 6,
 	TFXI_VIEW_FLUSH           = 1 << 7,
-	TFXI_VIEW_SORT_SEQUENTIAL = 1 << 8
+
+	// sort modes
+	TFXI_VIEW_SORT_SEQUENTIAL    = 1 << 8,
+	TFXI_VIEW_SORT_STATE         = 1 << 9,
+	TFXI_VIEW_SORT_FRONT_TO_BACK = 1 << 10,
+	TFXI_VIEW_SORT_BACK_TO_FRONT = 1 << 11
 };
 
 typedef struct tfx_rect {
@@ -177,39 +309,93 @@ typedef struct tfx_rect {
 } tfx_rect;
 
 typedef struct tfx_blit_op {
-	tfx_canvas *source;
+	// resolved when the frame executes, views may be double buffered.
+	uint8_t source_view;
 	int source_mip;
 	tfx_rect rect;
 	GLenum mask;
 } tfx_blit_op;
 
+// buffer copies and clears, run after the view's blits. gl ids are taken
+// when recorded, same as bindings.
+typedef struct tfx_copy_op {
+	GLuint dst;
+	GLuint src; // zero for clears
+	uint32_t dst_offset;
+	uint32_t src_offset;
+	uint32_t size;
+	uint32_t value;
+} tfx_copy_op;
+
+// values for clears without glClearBufferSubData, grown as needed.
+static uint32_t *g_clear_fill = NULL;
+
+// textures and storage buffers bound for a draw, shared between draws which
+// bind the same things.
+typedef struct tfx_bindings {
+	GLuint textures[8];
+	GLenum targets[8];
+	// internal format, for binding as an image
+	GLenum formats[8];
+	uint8_t mips[8];
+	GLuint buffers[8];
+	// ranges of suballocated buffers, a zero size binds the whole buffer.
+	uint32_t buffer_offsets[8];
+	uint32_t buffer_sizes[8];
+	uint8_t textures_write; // one bit per slot
+	uint8_t buffers_write;
+	uint8_t _pad0[2];
+} tfx_bindings;
+
+// marks an unused side table index
+#define TFXI_NONE 0xffffffff
+
+// draws get copied and sorted a lot, so keep them small. anything big lives
+// in side tables on the encoder which recorded the draw.
 typedef struct tfx_draw {
-	tfx_draw_callback callback;
+	uint64_t sort_key;
 	uint64_t flags;
-
+	tfx_draw_callback callback;
 	tfx_program program;
-	tfx_uniform *uniforms;
 
-	tfx_texture textures[8];
-	uint8_t textures_mip[8];
-	bool textures_write[8];
-	tfx_buffer ssbos[8];
-	bool ssbo_write[8];
-	tfx_buffer vbo;
-	bool use_vbo;
-
-	tfx_buffer ibo;
-	bool use_ibo;
+	// indices into the encoder's uniform_blocks, bindings and formats
+	uint32_t uniforms;
+	uint32_t uniform_count;
+	uint32_t bindings;
+	uint32_t format;
 
-	tfx_vertex_format tvb_fmt;
-	bool use_tvb;
+	GLuint vbo;
+	GLuint ibo;
+	// byte offsets of transient vertices, and of the first index. transient
+	// ones are into the chunk they were allocated from.
+	uint32_t offset;
+	uint32_t index_offset;
+	// first vertex of a suballocated vertex buffer.
+	uint32_t base_vertex;
+	uint32_t indices;
+	uint32_t depth;
 
 	tfx_rect scissor_rect;
-	bool use_scissor;
 
-	size_t offset;
-	uint32_t indices;
-	uint32_t depth;
+	// 0 draws a single instance
+	uint32_t instances;
+	GLuint instance_vbo;
+	uint32_t instance_format;
+
+	// buffer holding the draw or dispatch arguments, if they come from the GPU
+	GLuint indirect;
+	uint32_t indirect_offset;
+	uint32_t indirect_count;
+
+	uint8_t encoder;
+	bool use_vbo;
+	bool use_ibo;
+	bool use_tvb;
+	bool use_tib;
+	bool use_scissor;
+	bool index_32;
+	uint8_t tvb_chunk;
+	uint8_t tib_chunk;
 
 	// for compute jobs
 	uint32_t threads_x;
@@ -226,9 +412,8 @@ typedef struct tfx_view {
 	tfx_canvas  canvas;
 	int canvas_layer;
 
-	tfx_draw    *draws;
-	tfx_draw    *jobs;
 	tfx_blit_op *blits;
+	tfx_copy_op *copies;
 
 	unsigned clear_color;
 	float clear_depth;
@@ -248,6 +433,7 @@ typedef struct tfx_view {
 
 #define TFXI_VIEW_CLEAR_MASK      (TFXI_VIEW_CLEAR_COLOR | TFXI_VIEW_CLEAR_DEPTH)
 #define TFXI_VIEW_DEPTH_TEST_MASK (TFXI_VIEW_DEPTH_TEST_LT | TFXI_VIEW_DEPTH_TEST_GT | TFXI_VIEW_DEPTH_TEST_EQ)
+#define TFXI_VIEW_SORT_MASK       (TFXI_VIEW_SORT_SEQUENTIAL | TFXI_VIEW_SORT_STATE | TFXI_VIEW_SORT_FRONT_TO_BACK | TFXI_VIEW_SORT_BACK_TO_FRONT)
 
 #define TFXI_STATE_CULL_MASK      (TFX_STATE_CULL_CW | TFX_STATE_CULL_CCW)
 #define TFXI_STATE_BLEND_MASK     (TFX_STATE_BLEND_ALPHA)
@@ -278,11 +464,11 @@ static tfx_glext available_exts[] = {
 	{ "GL_ARB_seamless_cube_map", false },
 	{ "GL_EXT_texture_filter_anisotropic", false },
 	{ "GL_ARB_multi_bind", false },
+	{ "GL_ARB_multi_draw_indirect", false },
+	{ "GL_ARB_draw_indirect", false },
 	// TODO
 	// GL_AMD_vertex_shader_layer
 	// GL_AMD_vertex_shader_viewport_index
-	// GL_ARB_multi_bind
-	// GL_ARB_multi_draw_indirect
 	// GL_QCOM_texture_foveated
 	// GL_OVR_multiview2
 	// GL_OVR_multiview_multisampled_render_to_texture
@@ -356,6 +542,8 @@ PFNGLDELETEFRAMEBUFFERSPROC tfx_glDeleteFramebuffers;
 PFNGLBINDFRAMEBUFFERPROC tfx_glBindFramebuffer;
 PFNGLBLITFRAMEBUFFERPROC tfx_glBlitFramebuffer;
 PFNGLCOPYIMAGESUBDATAPROC tfx_glCopyImageSubData;
+PFNGLCOPYBUFFERSUBDATAPROC tfx_glCopyBufferSubData;
+PFNGLCLEARBUFFERSUBDATAPROC tfx_glClearBufferSubData;
 PFNGLFRAMEBUFFERTEXTURE2DPROC tfx_glFramebufferTexture2D;
 PFNGLINVALIDATEFRAMEBUFFERPROC tfx_glInvalidateFramebuffer;
 PFNGLGENRENDERBUFFERSPROC tfx_glGenRenderbuffers;
@@ -377,6 +565,14 @@ PFNGLUNMAPBUFFERPROC tfx_glUnmapBuffer;
 PFNGLUSEPROGRAMPROC tfx_glUseProgram;
 PFNGLMEMORYBARRIERPROC tfx_glMemoryBarrier;
 PFNGLBINDBUFFERBASEPROC tfx_glBindBufferBase;
+PFNGLBINDBUFFERRANGEPROC tfx_glBindBufferRange;
+PFNGLGETUNIFORMINDICESPROC tfx_glGetUniformIndices;
+PFNGLGETACTIVEUNIFORMSIVPROC tfx_glGetActiveUniformsiv;
+PFNGLGETACTIVEUNIFORMBLOCKIVPROC tfx_glGetActiveUniformBlockiv;
+PFNGLUNIFORMBLOCKBINDINGPROC tfx_glUniformBlockBinding;
+PFNGLFENCESYNCPROC tfx_glFenceSync;
+PFNGLCLIENTWAITSYNCPROC tfx_glClientWaitSync;
+PFNGLDELETESYNCPROC tfx_glDeleteSync;
 PFNGLDISPATCHCOMPUTEPROC tfx_glDispatchCompute;
 PFNGLVIEWPORTPROC tfx_glViewport;
 PFNGLVIEWPORTINDEXEDFPROC tfx_glViewportIndexedf;
@@ -400,12 +596,23 @@ PFNGLUNIFORMMATRIX3FVPROC tfx_glUniformMatrix3fv;
 PFNGLUNIFORMMATRIX4FVPROC tfx_glUniformMatrix4fv;
 PFNGLENABLEVERTEXATTRIBARRAYPROC tfx_glEnableVertexAttribArray;
 PFNGLVERTEXATTRIBPOINTERPROC tfx_glVertexAttribPointer;
+PFNGLVERTEXATTRIBFORMATPROC tfx_glVertexAttribFormat;
+PFNGLVERTEXATTRIBBINDINGPROC tfx_glVertexAttribBinding;
+PFNGLBINDVERTEXBUFFERPROC tfx_glBindVertexBuffer;
+PFNGLVERTEXBINDINGDIVISORPROC tfx_glVertexBindingDivisor;
+PFNGLVERTEXATTRIBDIVISORPROC tfx_glVertexAttribDivisor;
 PFNGLDISABLEVERTEXATTRIBARRAYPROC tfx_glDisableVertexAttribArray;
 PFNGLACTIVETEXTUREPROC tfx_glActiveTexture;
 PFNGLDRAWELEMENTSINSTANCEDPROC tfx_glDrawElementsInstanced;
 PFNGLDRAWARRAYSINSTANCEDPROC tfx_glDrawArraysInstanced;
+PFNGLDRAWELEMENTSINSTANCEDBASEVERTEXPROC tfx_glDrawElementsInstancedBaseVertex;
 PFNGLDRAWELEMENTSPROC tfx_glDrawElements;
 PFNGLDRAWARRAYSPROC tfx_glDrawArrays;
+PFNGLMULTIDRAWELEMENTSINDIRECTPROC tfx_glMultiDrawElementsIndirect;
+PFNGLMULTIDRAWARRAYSINDIRECTPROC tfx_glMultiDrawArraysIndirect;
+PFNGLDRAWELEMENTSINDIRECTPROC tfx_glDrawElementsIndirect;
+PFNGLDRAWARRAYSINDIRECTPROC tfx_glDrawArraysIndirect;
+PFNGLDISPATCHCOMPUTEINDIRECTPROC tfx_glDispatchComputeIndirect;
 PFNGLDELETEVERTEXARRAYSPROC tfx_glDeleteVertexArrays;
 PFNGLBINDFRAGDATALOCATIONPROC tfx_glBindFragDataLocation;
 
@@ -471,6 +678,8 @@ void load_em_up(void* (*get_proc_address)(const char*)) {
 	tfx_glBindFramebuffer = get_proc_address("glBindFramebuffer");
 	tfx_glBlitFramebuffer = get_proc_address("glBlitFramebuffer");
 	tfx_glCopyImageSubData = get_proc_address("glCopyImageSubData");
+	tfx_glCopyBufferSubData = get_proc_address("glCopyBufferSubData");
+	tfx_glClearBufferSubData = get_proc_address("glClearBufferSubData");
 	tfx_glFramebufferTexture2D = get_proc_address("glFramebufferTexture2D");
 	tfx_glInvalidateFramebuffer = get_proc_address("glInvalidateFramebuffer");
 	tfx_glGenRenderbuffers = get_proc_address("glGenRenderbuffers");
@@ -492,6 +701,14 @@ void load_em_up(void* (*get_proc_address)(const char*)) {
 	tfx_glUseProgram = get_proc_address("glUseProgram");
 	tfx_glMemoryBarrier = get_proc_address("glMemoryBarrier");
 	tfx_glBindBufferBase = get_proc_address("glBindBufferBase");
+	tfx_glBindBufferRange = get_proc_address("glBindBufferRange");
+	tfx_glGetUniformIndices = get_proc_address("glGetUniformIndices");
+	tfx_glGetActiveUniformsiv = get_proc_address("glGetActiveUniformsiv");
+	tfx_glGetActiveUniformBlockiv = get_proc_address("glGetActiveUniformBlockiv");
+	tfx_glUniformBlockBinding = get_proc_address("glUniformBlockBinding");
+	tfx_glFenceSync = get_proc_address("glFenceSync");
+	tfx_glClientWaitSync = get_proc_address("glClientWaitSync");
+	tfx_glDeleteSync = get_proc_address("glDeleteSync");
 	tfx_glDispatchCompute = get_proc_address("glDispatchCompute");
 	tfx_glViewport = get_proc_address("glViewport");
 	tfx_glViewportIndexedf = get_proc_address("glViewportIndexedf");
@@ -515,12 +732,23 @@ void load_em_up(void* (*get_proc_address)(const char*)) {
 	tfx_glUniformMatrix4fv = get_proc_address("glUniformMatrix4fv");
 	tfx_glEnableVertexAttribArray = get_proc_address("glEnableVertexAttribArray");
 	tfx_glVertexAttribPointer = get_proc_address("glVertexAttribPointer");
+	tfx_glVertexAttribFormat = get_proc_address("glVertexAttribFormat");
+	tfx_glVertexAttribBinding = get_proc_address("glVertexAttribBinding");
+	tfx_glBindVertexBuffer = get_proc_address("glBindVertexBuffer");
+	tfx_glVertexBindingDivisor = get_proc_address("glVertexBindingDivisor");
+	tfx_glVertexAttribDivisor = get_proc_address("glVertexAttribDivisor");
 	tfx_glDisableVertexAttribArray = get_proc_address("glDisableVertexAttribArray");
 	tfx_glActiveTexture = get_proc_address("glActiveTexture");
 	tfx_glDrawElementsInstanced = get_proc_address("glDrawElementsInstanced");
 	tfx_glDrawArraysInstanced = get_proc_address("glDrawArraysInstanced");
+	tfx_glDrawElementsInstancedBaseVertex = get_proc_address("glDrawElementsInstancedBaseVertex");
 	tfx_glDrawElements = get_proc_address("glDrawElements");
 	tfx_glDrawArrays = get_proc_address("glDrawArrays");
+	tfx_glMultiDrawElementsIndirect = get_proc_address("glMultiDrawElementsIndirect");
+	tfx_glMultiDrawArraysIndirect = get_proc_address("glMultiDrawArraysIndirect");
+	tfx_glDrawElementsIndirect = get_proc_address("glDrawElementsIndirect");
+	tfx_glDrawArraysIndirect = get_proc_address("glDrawArraysIndirect");
+	tfx_glDispatchComputeIndirect = get_proc_address("glDispatchComputeIndirect");
 	tfx_glDeleteVertexArrays = get_proc_address("glDeleteVertexArrays");
 	tfx_glBindFragDataLocation = get_proc_address("glBindFragDataLocation");
 
@@ -623,6 +851,7 @@ tfx_caps tfx_get_caps() {
 	bool gl30 = g_platform_data.context_version >= 30 && !g_platform_data.use_gles;
 	bool gl32 = g_platform_data.context_version >= 32 && !g_platform_data.use_gles;
 	bool gl33 = g_platform_data.context_version >= 33 && !g_platform_data.use_gles;
+	bool gl40 = g_platform_data.context_version >= 40 && !g_platform_data.use_gles;
 	bool gl43 = g_platform_data.context_version >= 43 && !g_platform_data.use_gles;
 	bool gl44 = g_platform_data.context_version >= 44 && !g_platform_data.use_gles;
 	bool gl46 = g_platform_data.context_version >= 46 && !g_platform_data.use_gles;
@@ -639,6 +868,8 @@ tfx_caps tfx_get_caps() {
 	caps.seamless_cubemap = available_exts[8].supported || gl32;
 	caps.anisotropic_filtering = available_exts[9].supported || gl46;
 	caps.multibind = available_exts[10].supported || gl44;
+	caps.multi_draw_indirect = available_exts[11].supported || gl43;
+	caps.draw_indirect = available_exts[12].supported || gl40 || gles31;
 
 	g_max_aniso = 0.0f;
 	GLenum GL_TEXTURE_MAX_ANISOTROPY_EXT = 0x84FE;
@@ -705,193 +936,578 @@ void tfx_dump_caps() {
 	tfx_printb(TFX_SEVERITY_INFO, "multisample", caps.multisample);
 }
 
-// this is all definitely not the simplest way to deal with maps for uniform
-// caches, but it's the simplest way I know which handles collisions.
-#define TFX_HASHSIZE 101
+// buffers and textures live in slots, and are looked up by an id made of the
+// slot and a generation that's bumped when the slot is freed. that makes
+// lookups a bounds and generation check, and ids of freed resources never match.
+#define TFXI_SLOT_BITS 20
+#define TFXI_SLOT_MASK ((1u << TFXI_SLOT_BITS) - 1)
 
-typedef struct tfx_set {
-	struct tfx_set *next;
-	const char *key;
-} tfx_set;
+typedef struct tfx_slots {
+	uint32_t *generations;
+	uint32_t *free;
+} tfx_slots;
+
+static uint32_t slot_alloc(tfx_slots *s) {
+	uint32_t index;
+	if (sb_count(s->free) > 0) {
+		index = sb_last(s->free);
+		stb__sbn(s->free) -= 1;
+	}
+	else {
+		index = sb_count(s->generations);
+		assert(index <= TFXI_SLOT_MASK);
+		sb_push(s->generations, 1);
+	}
+	return (s->generations[index] << TFXI_SLOT_BITS) | index;
+}
 
-static unsigned tfx_hash(const char *s) {
-	unsigned hashval;
-	for (hashval = 0; *s != '\0'; s++)
-		hashval = *s + 31 * hashval;
-	return hashval % TFX_HASHSIZE;
+// returns the slot of a live id, or -1 if it was freed.
+static int slot_find(tfx_slots *s, uint32_t id) {
+	uint32_t index = id & TFXI_SLOT_MASK;
+	if (id == 0 || index >= (uint32_t)sb_count(s->generations) || s->generations[index] != id >> TFXI_SLOT_BITS) {
+		return -1;
+	}
+	return (int)index;
 }
 
-static unsigned tfx_nohash(unsigned id) {
-	return id % TFX_HASHSIZE;
+static void slot_release(tfx_slots *s, int index) {
+	// generations wrap in the bits left over, skipping 0 so no id is 0.
+	uint32_t gen = (s->generations[index] + 1) & (0xffffffffu >> TFXI_SLOT_BITS);
+	s->generations[index] = gen ? gen : 1;
+	sb_push(s->free, (uint32_t)index);
 }
 
-static bool tfx_slookup(tfx_set **hashtab, const char *s) {
-#ifdef TFX_DEBUG
-	assert(s);
-#endif
-	struct tfx_set *np;
-	for (np = hashtab[tfx_hash(s)]; np != NULL; np = np->next) {
-		if (strcmp(s, np->key) == 0) {
-			return true;
-		}
-		//TFX_WARN("collision\n");
-	}
-	return false;
+static void slots_free(tfx_slots *s) {
+	sb_free(s->generations);
+	sb_free(s->free);
+	s->generations = NULL;
+	s->free = NULL;
 }
 
-static void tfx_sset(tfx_set **hashtab, const char *name) {
-	if (tfx_slookup(hashtab, name)) {
-		return;
-	}
+// suballocated buffers live in large GL buffers, each with a list of free
+// ranges sorted by offset. allocation is first fit, frees merge with their
+// neighbours, so the lists stay short unless things get very fragmented.
+typedef struct tfx_heap_range {
+	uint32_t offset;
+	uint32_t size;
+} tfx_heap_range;
 
-	unsigned hashval = tfx_hash(name);
-	tfx_set *np = malloc(sizeof(tfx_set));
-	np->key = name;
-	np->next = hashtab[hashval];
-	hashtab[hashval] = np;
+typedef struct tfx_heap_block {
+	GLuint gl_id;
+	tfx_heap_range *free;
+} tfx_heap_block;
+
+static struct {
+	tfx_heap_block *blocks;
+	// offset alignment for anything which may be bound as a storage buffer.
+	uint32_t align;
+} g_heap;
+
+static void heap_insert(tfx_heap_block *block, int at, uint32_t offset, uint32_t size) {
+	int nf = sb_count(block->free);
+	sb_add(block->free, 1);
+	memmove(&block->free[at + 1], &block->free[at], (nf - at) * sizeof(tfx_heap_range));
+	block->free[at].offset = offset;
+	block->free[at].size = size;
 }
 
-static tfx_set **tfx_set_new() {
-	return calloc(sizeof(tfx_set*), TFX_HASHSIZE);
+static void heap_remove(tfx_heap_block *block, int at) {
+	int nf = sb_count(block->free);
+	memmove(&block->free[at], &block->free[at + 1], (nf - at - 1) * sizeof(tfx_heap_range));
+	stb__sbn(block->free) -= 1;
 }
 
-static void tfx_set_delete(tfx_set **hashtab) {
-	for (int i = 0; i < TFX_HASHSIZE; i++) {
-		if (hashtab[i] != NULL) {
-			free(hashtab[i]);
+static bool heap_block_alloc(tfx_heap_block *block, uint32_t size, uint32_t align, uint32_t *offset) {
+	int nf = sb_count(block->free);
+	for (int i = 0; i < nf; i++) {
+		tfx_heap_range r = block->free[i];
+		uint64_t start = ((uint64_t)r.offset + align - 1) / align * align;
+		uint64_t end = (uint64_t)r.offset + r.size;
+		if (start + size > end) {
+			continue;
+		}
+		// whatever is left either side stays free.
+		uint32_t before = (uint32_t)(start - r.offset);
+		uint32_t after = (uint32_t)(end - start - size);
+		if (before > 0) {
+			block->free[i].size = before;
+			if (after > 0) {
+				heap_insert(block, i + 1, (uint32_t)start + size, after);
+			}
+		}
+		else if (after > 0) {
+			block->free[i].offset = (uint32_t)start + size;
+			block->free[i].size = after;
+		}
+		else {
+			heap_remove(block, i);
 		}
+		*offset = (uint32_t)start;
+		return true;
 	}
-	free(hashtab);
+	return false;
 }
 
-typedef struct tfx_locmap {
-	struct tfx_locmap *next;
-	const char *key;
-	GLuint value; // uniform location
-} tfx_locmap;
-
-static tfx_locmap *tfx_loclookup(tfx_locmap **hashtab, const char *s) {
-#ifdef TFX_DEBUG
-	assert(s);
-#endif
-	struct tfx_locmap *np;
-	for (np = hashtab[tfx_hash(s)]; np != NULL; np = np->next) {
-		if (strcmp(s, np->key) == 0) {
-			return np;
+static void heap_block_release(tfx_heap_block *block, uint32_t offset, uint32_t size) {
+	// find the first free range after this one.
+	int lo = 0;
+	int hi = sb_count(block->free);
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (block->free[mid].offset < offset) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
 		}
-		//TFX_WARN("collision\n");
 	}
-	return NULL;
-}
-
-static tfx_locmap* tfx_locset(tfx_locmap **hashtab, const char *name, GLuint value) {
-	tfx_locmap *found = tfx_loclookup(hashtab, name);
-	if (found) {
-		return NULL;
+	int nf = sb_count(block->free);
+	bool prev = lo > 0 && block->free[lo - 1].offset + block->free[lo - 1].size == offset;
+	bool next = lo < nf && offset + size == block->free[lo].offset;
+	if (prev && next) {
+		block->free[lo - 1].size += size + block->free[lo].size;
+		heap_remove(block, lo);
+	}
+	else if (prev) {
+		block->free[lo - 1].size += size;
+	}
+	else if (next) {
+		block->free[lo].offset = offset;
+		block->free[lo].size += size;
+	}
+	else {
+		heap_insert(block, lo, offset, size);
 	}
-
-	unsigned hashval = tfx_hash(name);
-	tfx_locmap *np = malloc(sizeof(tfx_locmap));
-	np->key = name;
-	np->next = hashtab[hashval];
-	np->value = value;
-	hashtab[hashval] = np;
-	return np;
 }
 
-static tfx_locmap **tfx_locmap_new() {
-	return calloc(sizeof(tfx_locmap*), TFX_HASHSIZE);
-}
+// returns false if the heap can't take it, the buffer gets its own GL buffer then.
+static bool heap_alloc(uint32_t size, uint32_t stride, GLuint *gl_id, uint32_t *offset) {
+	// vertex buffers are drawn from with base vertices.
+	if (!tfx_glDrawElementsInstancedBaseVertex || size == 0 || size > TFX_BUFFER_HEAP_BLOCK_SIZE) {
+		return false;
+	}
+	if (g_heap.align == 0) {
+		GLint align = 0;
+		CHECK(tfx_glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &align));
+		g_heap.align = align >= 4 ? (uint32_t)align : 256;
+	}
 
-static void tfx_locmap_delete(tfx_locmap **hashtab) {
-	for (int i = 0; i < TFX_HASHSIZE; i++) {
-		if (hashtab[i] != NULL) {
-			free(hashtab[i]);
+	// anything may be bound as storage, and vertices also need to start on a
+	// whole vertex, so they take the least common multiple of both.
+	uint32_t align = g_heap.align;
+	if (stride > 0) {
+		align = stride;
+		while (align % g_heap.align != 0) {
+			align += stride;
 		}
 	}
-	free(hashtab);
-}
-
-typedef struct tfx_shadermap {
-	struct tfx_shadermap *next;
-	GLint key; // shader program
-	tfx_locmap **value;
-} tfx_shadermap;
 
-static tfx_shadermap *tfx_proglookup(tfx_shadermap **hashtab, GLint program) {
-#ifdef TFX_DEBUG
-	assert(program);
-#endif
-	struct tfx_shadermap *np;
-	for (np = hashtab[tfx_nohash(program)]; np != NULL; np = np->next) {
-		if (program == np->key) {
-			return np;
+	int nb = sb_count(g_heap.blocks);
+	for (int i = 0; i < nb; i++) {
+		if (heap_block_alloc(&g_heap.blocks[i], size, align, offset)) {
+			*gl_id = g_heap.blocks[i].gl_id;
+			return true;
 		}
-		//TFX_WARN("collision\n");
 	}
-	return NULL;
-}
 
-static tfx_shadermap* tfx_progset(tfx_shadermap **hashtab, GLint program) {
-	tfx_shadermap *found = tfx_proglookup(hashtab, program);
-	if (found) {
-		return found;
+	// everything is full, add another block.
+	tfx_heap_block block;
+	memset(&block, 0, sizeof(tfx_heap_block));
+	CHECK(tfx_glGenBuffers(1, &block.gl_id));
+	CHECK(tfx_glBindBuffer(GL_ARRAY_BUFFER, block.gl_id));
+	if (tfx_glBufferStorage) {
+		CHECK(tfx_glBufferStorage(GL_ARRAY_BUFFER, TFX_BUFFER_HEAP_BLOCK_SIZE, NULL, GL_DYNAMIC_STORAGE_BIT | GL_MAP_WRITE_BIT));
+	}
+	else {
+		CHECK(tfx_glBufferData(GL_ARRAY_BUFFER, TFX_BUFFER_HEAP_BLOCK_SIZE, NULL, GL_DYNAMIC_DRAW));
 	}
+	heap_insert(&block, 0, 0, TFX_BUFFER_HEAP_BLOCK_SIZE);
+	sb_push(g_heap.blocks, block);
 
-	unsigned hashval = tfx_nohash(program);
-	tfx_shadermap *np = malloc(sizeof(tfx_shadermap));
-	np->key = program;
-	np->next = hashtab[hashval];
-	np->value = tfx_locmap_new();
-	hashtab[hashval] = np;
-	return np;
+	tfx_heap_block *added = &sb_last(g_heap.blocks);
+	bool ok = heap_block_alloc(added, size, align, offset);
+	assert(ok);
+	*gl_id = added->gl_id;
+	return ok;
 }
 
-static tfx_shadermap **tfx_progmap_new() {
-	return calloc(sizeof(tfx_shadermap*), TFX_HASHSIZE);
+// returns false if the buffer isn't from the heap.
+static bool heap_release(GLuint gl_id, uint32_t offset, uint32_t size) {
+	int nb = sb_count(g_heap.blocks);
+	for (int i = 0; i < nb; i++) {
+		if (g_heap.blocks[i].gl_id == gl_id) {
+			heap_block_release(&g_heap.blocks[i], offset, size);
+			return true;
+		}
+	}
+	return false;
 }
 
-static void tfx_progmap_delete(tfx_shadermap **hashtab) {
-	for (int i = 0; i < TFX_HASHSIZE; i++) {
-		if (hashtab[i] != NULL) {
-			tfx_locmap_delete(hashtab[i]->value);
-			free(hashtab[i]);
-		}
+static void heap_free_all() {
+	int nb = sb_count(g_heap.blocks);
+	for (int i = 0; i < nb; i++) {
+		CHECK(tfx_glDeleteBuffers(1, &g_heap.blocks[i].gl_id));
+		sb_free(g_heap.blocks[i].free);
 	}
-	free(hashtab);
+	sb_free(g_heap.blocks);
+	memset(&g_heap, 0, sizeof(g_heap));
 }
 
+// indexed by slot, freed slots have a zero id.
 static tfx_buffer *g_buffers;
+static tfx_slots g_buffer_slots;
+
+// a bundle submitted to a view, along with the uniforms of the encoder that submitted it.
+typedef struct tfx_bundle_ref {
+	tfx_bundle *bundle;
+	uint8_t encoder;
+	uint32_t uniforms;
+	uint32_t uniform_count;
+} tfx_bundle_ref;
+
+// recording state for one thread. encoder 0 backs the tfx_set_*/tfx_submit
+// functions, the rest are handed out by tfx_encoder_begin.
+struct tfx_encoder {
+	tfx_draw tmp_draw;
+	tfx_bindings tmp_bindings;
+	tfx_vertex_format tmp_format;
+	tfx_vertex_format tmp_instance_format;
+	bool use_bindings;
+
+	// most recent value of each uniform set this frame, carried into every
+	// draw submitted after it.
+	tfx_uniform *uniforms;
+	// index+1 into uniforms for each uniform id, 0 if it hasn't been set.
+	int *uniform_slots;
+	// index of the last snapshot of uniforms, reused until they change.
+	uint32_t uniform_block;
+	bool uniforms_dirty;
+
+	// side tables for this frame's draws
+	tfx_uniform *uniform_blocks;
+	tfx_bindings *bindings;
+	tfx_vertex_format *formats;
+
+	// uniform data. chunks never move, so draws can point right into them.
+	uint8_t **ub_chunks;
+	int ub_chunk;
+	size_t ub_cursor;
+	size_t ub_used;
+
+	tfx_draw *draws[VIEW_MAX];
+	tfx_draw *jobs[VIEW_MAX];
+	tfx_bundle_ref *bundles[VIEW_MAX];
+
+	bool active;
+	// recording a bundle, everything goes in the first view and is kept.
+	bool bundle;
+};
+
+// a bundle keeps an encoder's recording around, it's never flushed.
+struct tfx_bundle {
+	tfx_encoder encoder;
+	// sort keys for the draws, computed for the sort mode in key_mode when the
+	// bundle is first executed in a sorted view. only touched while executing.
+	uint64_t *keys;
+	uint32_t key_mode;
+};
+
+typedef struct tfx_buffer_update_op {
+	// skipped if the buffer is freed before the frame executes.
+	uint32_t id;
+	GLuint gl_id;
+	uint32_t offset;
+	uint32_t size;
+	// where the copied data is in the frame's update_data.
+	uint32_t data;
+	// order queued in, later updates win where ranges overlap.
+	uint32_t seq;
+} tfx_buffer_update_op;
+
+typedef struct tfx_texture_update_op {
+	// skipped if the texture is freed before the frame executes.
+	uint32_t id;
+	const void *data;
+} tfx_texture_update_op;
+
+// one frame's transient vertices or indices. the first chunk points straight
+// into the frame's slot when the buffers are persistently mapped, otherwise
+// it's a staging copy uploaded before drawing. frames that fill it chain on
+// more chunks, which are always staged and kept around for the next time.
+typedef struct tfx_transient_data {
+	uint8_t *chunks[TFX_TRANSIENT_CHUNK_MAX];
+	// allocated bytes across all chunks, each one holds size bytes.
+	uint32_t offset;
+	uint32_t size;
+	// allocations that didn't fit in any chunk.
+	uint32_t dropped;
+} tfx_transient_data;
 
 typedef struct tfx_frame_state {
-	// uniforms updated this frame
-	tfx_uniform *uniforms;
-	uint8_t *uniform_buffer;
-	uint8_t *ub_cursor;
-	tfx_shadermap **uniform_map;
 	tfx_view views[VIEW_MAX];
+	tfx_encoder encoders[TFX_ENCODER_MAX+1];
+
+	// transient vertex and index data for this frame.
+	tfx_transient_data transient;
+	tfx_transient_data transient_indices;
+	// which of the transient buffers this frame draws from.
+	int transient_slot;
+
+	// pending resource updates, captured when the frame is submitted. buffer
+	// update data is copied in when queued.
+	tfx_buffer_update_op *buffer_updates;
+	uint8_t *update_data;
+	tfx_texture_update_op *texture_updates;
+
+	// bundles freed while this frame was recording, released once it has executed.
+	tfx_bundle **bundle_frees;
 } tfx_frame_state;
 
 static tfx_frame_state g_back;  // staging update
-/*
-// TODO
-static tfx_frame_state g_front; // processing update
+static tfx_frame_state g_front; // processing update, only used with a render thread
+
+static bool g_render_thread = false;
+static bool g_render_quit = false;
+static tfx_sem g_render_ready; // posted when a frame is handed over
+static tfx_sem g_render_done;  // posted when the render thread is idle
+static tfx_stats g_render_stats;
+static tfx_timing_info g_render_timings[VIEW_MAX];
+
+static uint8_t *encoder_alloc(tfx_encoder *enc, size_t size) {
+	assert(size <= TFX_UNIFORM_CHUNK_SIZE);
+	enc->ub_used += size;
+	assert(enc->ub_used < TFX_UNIFORM_BUFFER_SIZE);
+
+	if (sb_count(enc->ub_chunks) == 0) {
+		sb_push(enc->ub_chunks, (uint8_t*)malloc(TFX_UNIFORM_CHUNK_SIZE));
+		enc->ub_chunk = 0;
+		enc->ub_cursor = 0;
+	}
+	if (enc->ub_cursor + size > TFX_UNIFORM_CHUNK_SIZE) {
+		enc->ub_chunk += 1;
+		enc->ub_cursor = 0;
+		if (enc->ub_chunk == sb_count(enc->ub_chunks)) {
+			sb_push(enc->ub_chunks, (uint8_t*)malloc(TFX_UNIFORM_CHUNK_SIZE));
+		}
+	}
+
+	uint8_t *ptr = enc->ub_chunks[enc->ub_chunk] + enc->ub_cursor;
+	enc->ub_cursor += size;
+	return ptr;
+}
+
+// drop everything recorded this frame. all the storage is kept for reuse.
+static void encoder_flush(tfx_encoder *enc) {
+	for (int id = 0; id < VIEW_MAX; id++) {
+		sb_clear(enc->draws[id]);
+		sb_clear(enc->jobs[id]);
+		sb_clear(enc->bundles[id]);
+	}
+
+	int nu = sb_count(enc->uniforms);
+	for (int i = 0; i < nu; i++) {
+		enc->uniform_slots[enc->uniforms[i].id] = 0;
+	}
+	sb_clear(enc->uniforms);
+	enc->uniform_block = TFXI_NONE;
+	enc->uniforms_dirty = false;
+
+	sb_clear(enc->uniform_blocks);
+	sb_clear(enc->bindings);
+	sb_clear(enc->formats);
+
+	enc->ub_chunk = 0;
+	enc->ub_cursor = 0;
+	enc->ub_used = 0;
+
+	memset(&enc->tmp_draw, 0, sizeof(tfx_draw));
+	memset(&enc->tmp_bindings, 0, sizeof(tfx_bindings));
+	memset(&enc->tmp_format, 0, sizeof(tfx_vertex_format));
+	memset(&enc->tmp_instance_format, 0, sizeof(tfx_vertex_format));
+	enc->use_bindings = false;
+}
 
-void swap_state_buffer() {
-	tfx_frame_state tmp;
-	memcpy(&tmp, &g_back, sizeof(tfx_frame_state));
+static void encoder_free(tfx_encoder *enc) {
+	encoder_flush(enc);
 
-	g_back = g_front;
-	g_front = tmp;
+	for (int id = 0; id < VIEW_MAX; id++) {
+		sb_free(enc->draws[id]);
+		sb_free(enc->jobs[id]);
+		sb_free(enc->bundles[id]);
+		enc->draws[id] = NULL;
+		enc->jobs[id] = NULL;
+		enc->bundles[id] = NULL;
+	}
+
+	sb_free(enc->uniforms);
+	sb_free(enc->uniform_slots);
+	sb_free(enc->uniform_blocks);
+	sb_free(enc->bindings);
+	sb_free(enc->formats);
+	enc->uniforms = NULL;
+	enc->uniform_slots = NULL;
+	enc->uniform_blocks = NULL;
+	enc->bindings = NULL;
+	enc->formats = NULL;
+
+	int nc = sb_count(enc->ub_chunks);
+	for (int i = 0; i < nc; i++) {
+		free(enc->ub_chunks[i]);
+	}
+	sb_free(enc->ub_chunks);
+	enc->ub_chunks = NULL;
 }
-*/
 
+// one slot per frame in flight, each frame records into and draws from its
+// own. only the first chunk of each slot is created up front.
 static struct {
-	uint8_t *data;
-	uint32_t offset;
-	tfx_buffer buffers[TFX_TRANSIENT_BUFFER_COUNT];
+	tfx_buffer buffers[TFX_TRANSIENT_BUFFER_COUNT][TFX_TRANSIENT_CHUNK_MAX];
+	tfx_buffer indices[TFX_TRANSIENT_BUFFER_COUNT][TFX_TRANSIENT_CHUNK_MAX];
+	// set when every slot is persistently mapped, so frames are written in place.
+	bool persistent;
+	uint8_t *mapped[TFX_TRANSIENT_BUFFER_COUNT];
+	uint8_t *mapped_indices[TFX_TRANSIENT_BUFFER_COUNT];
+	GLsync fences[TFX_TRANSIENT_BUFFER_COUNT];
+	// allocations that don't fit are pointed here instead, so writing them is
+	// harmless. one per power of two size, allocated when first needed.
+	uint8_t *sinks[33];
+	// most transient bytes used by any frame so far.
+	uint32_t peak;
 } g_transient_buffer;
 
+// times the CPU had to wait on the GPU this frame.
+static uint32_t g_fence_stalls = 0;
+
+// waits for a fence and deletes it. returns true if the GPU wasn't done yet.
+static bool fence_wait(GLsync fence) {
+	GLenum status = CHECK(tfx_glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0));
+	bool stalled = status == GL_TIMEOUT_EXPIRED;
+	while (status == GL_TIMEOUT_EXPIRED) {
+		status = CHECK(tfx_glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000));
+	}
+	CHECK(tfx_glDeleteSync(fence));
+	if (stalled) {
+		g_fence_stalls += 1;
+	}
+	return stalled;
+}
+
+// vertex arrays are kept for every vertex buffer, index buffer and format
+// drawn with, so drawing a known mesh is a single bind.
+typedef struct tfx_vao {
+	GLuint gl_id;
+	GLuint vbo;
+	GLuint ibo;
+	GLuint instance_vbo;
+	tfx_vertex_format format;
+	tfx_vertex_format instance_format;
+} tfx_vao;
+
+#define TFXI_VAO_BUCKETS 256
+static tfx_vao *g_vaos[TFXI_VAO_BUCKETS];
+
+// transient and attribute-less draws are set up per draw on this one.
+static GLuint g_scratch_vao = 0;
+static int g_scratch_attribs = 0;
+// with separate vertex formats (GL 4.3/ES 3.1) the scratch array only gets a
+// new format when it changes, otherwise just the buffer binding moves.
+static bool g_scratch_has_format = false;
+static tfx_vertex_format g_scratch_format;
+static tfx_vertex_format g_scratch_instance_format;
+static GLuint g_scratch_vbo = 0;
+static uint32_t g_scratch_offset = 0;
+static GLuint g_scratch_instance_vbo = 0;
+// element buffer bound while the scratch array is, 0 when unknown.
+static GLuint g_scratch_ibo = 0;
+// attributes with a divisor set, without separate formats they're per attribute.
+static uint16_t g_scratch_divided = 0;
+
+static uint32_t vao_bucket(GLuint vbo, GLuint ibo, GLuint instance_vbo) {
+	return ((vbo ^ (ibo << 11) ^ (instance_vbo << 22)) * 2654435761u) >> 24;
+}
+
+// drop any vertex arrays using a buffer, its id may be reused.
+static void vao_forget(GLuint buffer) {
+	for (int b = 0; b < TFXI_VAO_BUCKETS; b++) {
+		tfx_vao *bucket = g_vaos[b];
+		int n = sb_count(bucket);
+		int keep = 0;
+		for (int i = 0; i < n; i++) {
+			if (bucket[i].vbo == buffer || bucket[i].ibo == buffer || bucket[i].instance_vbo == buffer) {
+				CHECK(tfx_glDeleteVertexArrays(1, &bucket[i].gl_id));
+				continue;
+			}
+			bucket[keep++] = bucket[i];
+		}
+		if (n > 0) {
+			stb__sbn(bucket) = keep;
+		}
+	}
+	// GL detaches deleted buffers from the scratch array, so a reused name
+	// must not look like it's still bound.
+	g_scratch_vbo = 0;
+	g_scratch_offset = 0;
+	g_scratch_instance_vbo = 0;
+	g_scratch_ibo = 0;
+}
+
+static void vao_free_all() {
+	for (int b = 0; b < TFXI_VAO_BUCKETS; b++) {
+		int n = sb_count(g_vaos[b]);
+		for (int i = 0; i < n; i++) {
+			CHECK(tfx_glDeleteVertexArrays(1, &g_vaos[b][i].gl_id));
+		}
+		sb_free(g_vaos[b]);
+		g_vaos[b] = NULL;
+	}
+	if (g_scratch_vao) {
+		CHECK(tfx_glDeleteVertexArrays(1, &g_scratch_vao));
+		g_scratch_vao = 0;
+	}
+	g_scratch_attribs = 0;
+	g_scratch_has_format = false;
+	g_scratch_vbo = 0;
+	g_scratch_instance_vbo = 0;
+	g_scratch_ibo = 0;
+	g_scratch_divided = 0;
+}
+
+// command layout for both indirect draw types, arrays ignore base_vertex.
+// first is the first vertex for arrays, or the first index for elements.
+typedef struct tfx_indirect_cmd {
+	uint32_t count;
+	uint32_t instances;
+	uint32_t first;
+	uint32_t base_vertex;
+	uint32_t base_instance;
+} tfx_indirect_cmd;
+
+// commands for batched draws, rewritten every frame.
+static struct {
+	GLuint gl_id;
+	uint32_t size;
+	uint32_t offset;
+	tfx_indirect_cmd *cmds;
+} g_indirect;
+
+static void indirect_free() {
+	if (g_indirect.gl_id) {
+		CHECK(tfx_glDeleteBuffers(1, &g_indirect.gl_id));
+	}
+	sb_free(g_indirect.cmds);
+	memset(&g_indirect, 0, sizeof(g_indirect));
+}
+
+typedef struct tfx_sort_item {
+	uint64_t key;
+	tfx_draw *draw;
+	// set for draws from bundles, their side tables are in the bundle.
+	tfx_bundle_ref *ref;
+} tfx_sort_item;
+
+static tfx_sort_item *g_sort_items = NULL;
+static tfx_sort_item *g_sort_scratch = NULL;
+
 static tfx_caps g_caps;
 
 // fallback printf
@@ -905,23 +1521,94 @@ static void basic_log(const char *msg, tfx_severity level) {
 #endif
 }
 
-static void tvb_reset() {
-	g_transient_buffer.offset = 0;
+// creates a transient buffer, returning its persistent mapping if requested and it worked.
+static GLuint tvb_create(GLenum target, GLsizeiptr size, bool persistent, uint8_t **mapped) {
+	GLuint id;
+	CHECK(tfx_glGenBuffers(1, &id));
+	CHECK(tfx_glBindBuffer(target, id));
+	*mapped = NULL;
+	if (persistent) {
+		GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		CHECK(tfx_glBufferStorage(target, size, NULL, access));
+		*mapped = tfx_glMapBufferRange(target, 0, size, access);
+	}
+	else if (tfx_glBufferStorage) {
+		CHECK(tfx_glBufferStorage(target, size, NULL, GL_DYNAMIC_STORAGE_BIT | GL_MAP_WRITE_BIT));
+	}
+	else {
+		CHECK(tfx_glBufferData(target, size, NULL, GL_DYNAMIC_DRAW));
+	}
+	return id;
+}
 
+static void tvb_reset() {
+	// write transient data in place when we can, that saves a copy of every byte.
+	bool persistent = tfx_glBufferStorage && tfx_glMapBufferRange && tfx_glFenceSync && tfx_glClientWaitSync && tfx_glDeleteSync;
 	for (int i = 0; i < TFX_TRANSIENT_BUFFER_COUNT; i++) {
-		if (!g_transient_buffer.buffers[i].gl_id) {
-			GLuint id;
-			CHECK(tfx_glGenBuffers(1, &id));
-			CHECK(tfx_glBindBuffer(GL_ARRAY_BUFFER, id));
-			if (tfx_glBufferStorage) {
-				CHECK(tfx_glBufferStorage(GL_ARRAY_BUFFER, TFX_TRANSIENT_BUFFER_SIZE, NULL, GL_DYNAMIC_STORAGE_BIT | GL_MAP_WRITE_BIT));
-			}
-			else {
-				CHECK(tfx_glBufferData(GL_ARRAY_BUFFER, TFX_TRANSIENT_BUFFER_SIZE, NULL, GL_DYNAMIC_DRAW));
-			}
-			g_transient_buffer.buffers[i].gl_id = id;
+		if (!g_transient_buffer.buffers[i][0].gl_id) {
+			g_transient_buffer.buffers[i][0].gl_id = tvb_create(GL_ARRAY_BUFFER, TFX_TRANSIENT_BUFFER_SIZE, persistent, &g_transient_buffer.mapped[i]);
+		}
+		if (!g_transient_buffer.indices[i][0].gl_id) {
+			g_transient_buffer.indices[i][0].gl_id = tvb_create(GL_ELEMENT_ARRAY_BUFFER, TFX_TRANSIENT_INDEX_BUFFER_SIZE, persistent, &g_transient_buffer.mapped_indices[i]);
 		}
+		persistent = persistent && g_transient_buffer.mapped[i] && g_transient_buffer.mapped_indices[i];
+	}
+	g_transient_buffer.persistent = persistent;
+
+	g_back.transient.size = TFX_TRANSIENT_BUFFER_SIZE;
+	g_front.transient.size = TFX_TRANSIENT_BUFFER_SIZE;
+	g_back.transient_indices.size = TFX_TRANSIENT_INDEX_BUFFER_SIZE;
+	g_front.transient_indices.size = TFX_TRANSIENT_INDEX_BUFFER_SIZE;
+	g_back.transient_slot = 0;
+	g_front.transient_slot = 0;
+	if (persistent) {
+		g_back.transient.chunks[0] = g_transient_buffer.mapped[0];
+		g_back.transient_indices.chunks[0] = g_transient_buffer.mapped_indices[0];
+		return;
+	}
+
+	// the front copy is only needed when the render thread uploads one frame while the next is recorded.
+	g_back.transient.chunks[0] = (uint8_t*)malloc(TFX_TRANSIENT_BUFFER_SIZE);
+	g_front.transient.chunks[0] = (uint8_t*)malloc(TFX_TRANSIENT_BUFFER_SIZE);
+	memset(g_back.transient.chunks[0], 0xfc, TFX_TRANSIENT_BUFFER_SIZE);
+	memset(g_front.transient.chunks[0], 0xfc, TFX_TRANSIENT_BUFFER_SIZE);
+	g_back.transient_indices.chunks[0] = (uint8_t*)malloc(TFX_TRANSIENT_INDEX_BUFFER_SIZE);
+	g_front.transient_indices.chunks[0] = (uint8_t*)malloc(TFX_TRANSIENT_INDEX_BUFFER_SIZE);
+}
+
+// move a frame on to the next slot, pointing it at that slot's mapping if there is one.
+static void tvb_next_slot(tfx_frame_state *fs) {
+	fs->transient_slot = (fs->transient_slot + 1) % TFX_TRANSIENT_BUFFER_COUNT;
+	if (g_transient_buffer.persistent) {
+		fs->transient.chunks[0] = g_transient_buffer.mapped[fs->transient_slot];
+		fs->transient_indices.chunks[0] = g_transient_buffer.mapped_indices[fs->transient_slot];
+	}
+}
+
+static void tvb_free(tfx_transient_data *td) {
+	// a mapped first chunk goes away with its buffer.
+	for (int i = g_transient_buffer.persistent ? 1 : 0; i < TFX_TRANSIENT_CHUNK_MAX; i++) {
+		free(td->chunks[i]);
 	}
+	memset(td, 0, sizeof(tfx_transient_data));
+}
+
+static void tvb_fence(int slot) {
+	GLsync *fence = &g_transient_buffer.fences[slot];
+	if (*fence) {
+		CHECK(tfx_glDeleteSync(*fence));
+	}
+	*fence = CHECK(tfx_glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+}
+
+// block until the GPU is done with a slot, so it can be written again.
+static void tvb_wait(int slot) {
+	GLsync fence = g_transient_buffer.fences[slot];
+	if (!fence) {
+		return;
+	}
+	fence_wait(fence);
+	g_transient_buffer.fences[slot] = NULL;
 }
 
 void tfx_set_platform_data(tfx_platform_data pd) {
@@ -937,49 +1624,192 @@ void tfx_set_platform_data(tfx_platform_data pd) {
 	memcpy(&g_platform_data, &pd, sizeof(tfx_platform_data));
 }
 
+// reserves space in a frame's transient data, chaining on a chunk when the
+// current one is full. encoders may allocate from any thread. the offset is
+// across all chunks, returns false when there's no room left at all.
+static bool transient_alloc(tfx_transient_data *td, uint32_t size, tfx_transient_buffer *buf) {
+	// single allocations can't span chunks, bigger ones are dropped below.
+	uint32_t offset, start;
+	do {
+		offset = tfx_atomic_add(&td->offset, 0);
+		start = offset;
+		if (start % td->size + size > td->size) {
+			start = (start / td->size + 1) * td->size;
+		}
+		if (size > td->size || start / td->size >= TFX_TRANSIENT_CHUNK_MAX) {
+			if (tfx_atomic_add(&td->dropped, 1) == 0) {
+				TFX_WARN("Out of transient buffer space, dropping allocations (%u bytes)", size);
+			}
+			return false;
+		}
+	} while (!tfx_atomic_cas(&td->offset, offset, start + size));
+
+	uint32_t chunk = start / td->size;
+	uint8_t *data = tfx_atomic_load_ptr(&td->chunks[chunk]);
+	if (!data) {
+		// first time this frame state got this far, someone else may be doing the same.
+		uint8_t *fresh = (uint8_t*)malloc(td->size);
+		if (tfx_atomic_cas_ptr(&td->chunks[chunk], NULL, fresh)) {
+			data = fresh;
+		}
+		else {
+			free(fresh);
+			data = tfx_atomic_load_ptr(&td->chunks[chunk]);
+		}
+	}
+	buf->data = data + start % td->size;
+	buf->offset = start;
+	return true;
+}
+
+// where dropped allocations are written, so apps don't need to check for them.
+static tfx_transient_buffer transient_dropped(tfx_transient_buffer buf, uint64_t size) {
+	// sinks are never replaced, other threads may still be writing to them.
+	int bits = 16;
+	while (bits < 32 && ((uint64_t)1 << bits) < size) {
+		bits += 1;
+	}
+	// nothing sensible can hold more than that.
+	if (size > ((uint64_t)1 << bits)) {
+		buf.num = 0;
+		buf.offset = 0;
+		buf.data = NULL;
+		return buf;
+	}
+	uint8_t *sink = tfx_atomic_load_ptr(&g_transient_buffer.sinks[bits]);
+	if (!sink) {
+		uint8_t *fresh = (uint8_t*)malloc((size_t)1 << bits);
+		if (tfx_atomic_cas_ptr(&g_transient_buffer.sinks[bits], NULL, fresh)) {
+			sink = fresh;
+		}
+		else {
+			free(fresh);
+			sink = tfx_atomic_load_ptr(&g_transient_buffer.sinks[bits]);
+		}
+	}
+	// nothing is drawn from it.
+	buf.num = 0;
+	buf.offset = 0;
+	buf.data = sink;
+	return buf;
+}
+
+tfx_transient_buffer tfx_transient_indices_new(uint32_t num_indices, bool index_32) {
+	tfx_transient_buffer buf;
+	memset(&buf, 0, sizeof(tfx_transient_buffer));
+	buf.num = num_indices;
+	buf.index_32 = index_32;
+	// in 64 bits, anything which doesn't fit a buffer is dropped before it can wrap.
+	uint64_t bytes = (uint64_t)num_indices * (index_32 ? 4 : 2);
+	if (bytes > g_back.transient_indices.size) {
+		if (tfx_atomic_add(&g_back.transient_indices.dropped, 1) == 0) {
+			TFX_WARN("Transient indices larger than a whole buffer, dropping allocation (%u indices)", num_indices);
+		}
+		return transient_dropped(buf, bytes);
+	}
+	uint32_t size = ((uint32_t)bytes + 3) & ~3u;
+
+	if (!transient_alloc(&g_back.transient_indices, size, &buf)) {
+		return transient_dropped(buf, size);
+	}
+	return buf;
+}
+
 // null format = index buffer
 tfx_transient_buffer tfx_transient_buffer_new(tfx_vertex_format *fmt, uint16_t num_verts) {
-	// transient index buffers aren't supported yet
-	assert(fmt != NULL);
+	if (!fmt) {
+		return tfx_transient_indices_new(num_verts, false);
+	}
 	assert(fmt->stride > 0);
 
 	tfx_transient_buffer buf;
 	memset(&buf, 0, sizeof(tfx_transient_buffer));
-	buf.data = g_transient_buffer.data + g_transient_buffer.offset;
 	buf.num = num_verts;
-	buf.offset = g_transient_buffer.offset;
-	uint32_t stride = sizeof(uint16_t);
-	if (fmt) {
-		buf.has_format = true;
-		buf.format = *fmt;
-		stride = (uint32_t)fmt->stride;
-	}
-	g_transient_buffer.offset += (uint32_t)(num_verts * stride);
-	g_transient_buffer.offset += g_transient_buffer.offset % 4; // align, in case the stride is weird
+	buf.has_format = true;
+	buf.format = *fmt;
+	uint32_t size = (uint32_t)(num_verts * fmt->stride);
+	size = (size + 3) & ~3u; // align, in case the stride is weird
+
+	if (!transient_alloc(&g_back.transient, size, &buf)) {
+		return transient_dropped(buf, size);
+	}
 	return buf;
 }
 
+// the most bytes a single allocation can get, a whole chunk if another can be chained on.
+static uint32_t transient_available(tfx_transient_data *td) {
+	uint32_t offset = tfx_atomic_add(&td->offset, 0);
+	uint32_t chunk = offset / td->size;
+	if (chunk + 1 < TFX_TRANSIENT_CHUNK_MAX) {
+		return td->size;
+	}
+	if (chunk >= TFX_TRANSIENT_CHUNK_MAX) {
+		return 0;
+	}
+	return td->size - offset % td->size;
+}
+
 // null format = available indices (uint16)
 uint32_t tfx_transient_buffer_get_available(tfx_vertex_format *fmt) {
-	assert(fmt->stride > 0);
-	uint32_t avail = TFX_TRANSIENT_BUFFER_SIZE;
-	avail -= g_transient_buffer.offset;
-	uint32_t stride = sizeof(uint16_t);
-	if (fmt) {
-		stride = fmt->stride;
+	if (!fmt) {
+		return transient_available(&g_back.transient_indices) / sizeof(uint16_t);
 	}
-	avail /= (uint32_t)stride;
+	assert(fmt->stride > 0);
+	uint32_t avail = transient_available(&g_back.transient);
+	avail /= (uint32_t)fmt->stride;
 	return avail;
 }
 
 static tfx_program *g_programs = NULL;
+// what a program knows about a uniform: where it is, and the last value
+// uploaded to it so repeats can be skipped.
+typedef struct tfx_uniform_slot {
+	GLint location;
+	int count;
+	uint32_t size;
+	uint32_t capacity;
+	uint8_t *shadow;
+
+	// for members of uniform blocks, index into the program's blocks and std140 layout.
+	int block;
+	GLint offset;
+	GLint array_stride;
+	GLint matrix_stride;
+} tfx_uniform_slot;
+
+// a uniform block of a program. the contents are built up in shadow, then
+// copied into the uniform ring whenever they change.
+typedef struct tfx_uniform_block {
+	GLuint binding;
+	uint32_t size;
+	uint8_t *shadow;
+	bool dirty;
+	// where the current contents live in the ring, valid while epoch matches.
+	uint32_t epoch;
+	uint32_t offset;
+} tfx_uniform_block;
+
+typedef struct tfx_program_info {
+	// indexed by uniform id
+	tfx_uniform_slot *uniforms;
+	tfx_uniform_block *blocks;
+	bool blocks_queried;
+} tfx_program_info;
+
+// uniform info indexed by GL program name, only touched while executing frames.
+// entries are made as programs get drawn with, so programs from elsewhere work too.
+static tfx_program_info *g_program_info = NULL;
+// indexed by slot like g_buffers.
 static tfx_texture *g_textures = NULL;
+static tfx_slots g_texture_slots;
 static tfx_reset_flags g_flags = TFX_RESET_NONE;
 static GLuint g_timers[TIMER_COUNT];
 static int g_timer_offset = 0;
 static bool use_timers = false;
 
 static uint32_t *g_debug_data = NULL;
+// pixels from the last submitted frame, waiting for upload.
+static uint32_t *g_debug_staged = NULL;
 static tfx_program g_debug_program = 0;
 static tfx_texture g_debug_overlay;
 static tfx_uniform g_debug_texture;
@@ -1014,23 +1844,271 @@ static const char *g_debug_fss =
 	"}\n"
 ;
 
-static const char *g_debug_attribs[] = { "v_position", NULL };
-static bool did_you_call_tfx_reset = false;
-
-void tfx_reset(uint16_t width, uint16_t height, tfx_reset_flags flags) {
-	if (g_platform_data.gl_get_proc_address != NULL) {
-		load_em_up(g_platform_data.gl_get_proc_address);
+// forget everything known about program uniforms, for switching uniform backends.
+static void program_info_clear() {
+	int np = sb_count(g_program_info);
+	for (int i = 0; i < np; i++) {
+		tfx_program_info *info = &g_program_info[i];
+		int nu = sb_count(info->uniforms);
+		for (int j = 0; j < nu; j++) {
+			free(info->uniforms[j].shadow);
+		}
+		sb_free(info->uniforms);
+		int nb = sb_count(info->blocks);
+		for (int j = 0; j < nb; j++) {
+			free(info->blocks[j].shadow);
+		}
+		sb_free(info->blocks);
+		memset(info, 0, sizeof(tfx_program_info));
 	}
+}
 
-	did_you_call_tfx_reset = true;
-
-	g_caps = tfx_get_caps();
-	// we require these, unless/until backporting for pre-compute HW.
-	assert(g_caps.instancing);
-	assert(g_caps.compute);
+#define TFXI_UNIFORM_BLOCK_MAX 16
 
-	g_flags = TFX_RESET_NONE;
-	if (g_caps.anisotropic_filtering && (flags & TFX_RESET_MAX_ANISOTROPY) == TFX_RESET_MAX_ANISOTROPY) {
+// persistently mapped ring for uniform blocks, split into one slice per frame in flight.
+static struct {
+	GLuint gl_id;
+	uint8_t *ptr;
+	uint32_t align;
+	uint32_t slice;
+	uint32_t offset;
+	// bumped whenever a slice is reused, anything uploaded before that may be overwritten.
+	uint32_t epoch;
+	GLsync fences[TFX_UNIFORM_RING_FRAMES];
+	// what's bound to each binding point, so repeated binds can be skipped.
+	uint32_t bound[TFXI_UNIFORM_BLOCK_MAX];
+} g_uniform_ring;
+
+static bool uniform_ring_init() {
+	memset(&g_uniform_ring, 0, sizeof(g_uniform_ring));
+	if (!tfx_glBufferStorage || !tfx_glMapBufferRange || !tfx_glFenceSync || !tfx_glClientWaitSync || !tfx_glDeleteSync) {
+		return false;
+	}
+	if (!tfx_glBindBufferRange || !tfx_glGetUniformIndices || !tfx_glGetActiveUniformsiv || !tfx_glGetActiveUniformBlockiv || !tfx_glUniformBlockBinding) {
+		return false;
+	}
+
+	GLint align = 0;
+	CHECK(tfx_glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align));
+	g_uniform_ring.align = align > 0 ? (uint32_t)align : 256;
+
+	GLsizeiptr size = (GLsizeiptr)TFX_UNIFORM_RING_SIZE * TFX_UNIFORM_RING_FRAMES;
+	GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	CHECK(tfx_glGenBuffers(1, &g_uniform_ring.gl_id));
+	CHECK(tfx_glBindBuffer(GL_UNIFORM_BUFFER, g_uniform_ring.gl_id));
+	CHECK(tfx_glBufferStorage(GL_UNIFORM_BUFFER, size, NULL, access));
+	g_uniform_ring.ptr = tfx_glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, access);
+	CHECK(tfx_glBindBuffer(GL_UNIFORM_BUFFER, 0));
+	if (!g_uniform_ring.ptr) {
+		CHECK(tfx_glDeleteBuffers(1, &g_uniform_ring.gl_id));
+		g_uniform_ring.gl_id = 0;
+		return false;
+	}
+	return true;
+}
+
+static void uniform_ring_free() {
+	if (!g_uniform_ring.gl_id) {
+		return;
+	}
+	for (int i = 0; i < TFX_UNIFORM_RING_FRAMES; i++) {
+		if (g_uniform_ring.fences[i]) {
+			CHECK(tfx_glDeleteSync(g_uniform_ring.fences[i]));
+		}
+	}
+	CHECK(tfx_glBindBuffer(GL_UNIFORM_BUFFER, g_uniform_ring.gl_id));
+	CHECK(tfx_glUnmapBuffer(GL_UNIFORM_BUFFER));
+	CHECK(tfx_glBindBuffer(GL_UNIFORM_BUFFER, 0));
+	CHECK(tfx_glDeleteBuffers(1, &g_uniform_ring.gl_id));
+	memset(&g_uniform_ring, 0, sizeof(g_uniform_ring));
+}
+
+// move on to the next slice, waiting for the GPU if it's still reading from it.
+static void uniform_ring_next() {
+	g_uniform_ring.slice = (g_uniform_ring.slice + 1) % TFX_UNIFORM_RING_FRAMES;
+	GLsync fence = g_uniform_ring.fences[g_uniform_ring.slice];
+	if (fence) {
+		fence_wait(fence);
+		g_uniform_ring.fences[g_uniform_ring.slice] = NULL;
+	}
+	g_uniform_ring.offset = 0;
+	g_uniform_ring.epoch += 1;
+}
+
+static void uniform_ring_fence() {
+	GLsync *fence = &g_uniform_ring.fences[g_uniform_ring.slice];
+	if (*fence) {
+		CHECK(tfx_glDeleteSync(*fence));
+	}
+	*fence = CHECK(tfx_glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+}
+
+static void uniform_ring_begin() {
+	uniform_ring_next();
+	memset(g_uniform_ring.bound, 0xff, sizeof(g_uniform_ring.bound));
+}
+
+// returns an offset into the whole ring.
+static uint32_t uniform_ring_alloc(uint32_t size) {
+	assert(size <= TFX_UNIFORM_RING_SIZE);
+	uint32_t align = g_uniform_ring.align;
+	uint32_t offset = (g_uniform_ring.offset + align - 1) / align * align;
+	if (offset + size > TFX_UNIFORM_RING_SIZE) {
+		// out of room for this frame, spill into the next slice.
+		uniform_ring_fence();
+		uniform_ring_next();
+		offset = 0;
+	}
+	g_uniform_ring.offset = offset + size;
+	return g_uniform_ring.slice * TFX_UNIFORM_RING_SIZE + offset;
+}
+
+// a copy of data waiting to be uploaded into a buffer or texture.
+typedef struct tfx_upload {
+	uint32_t ticket;
+	// registry id of the buffer or texture, uploads for freed ones are dropped.
+	uint32_t id;
+	bool texture;
+	uint16_t mip;
+	uint32_t offset;
+	uint32_t size;
+	void *data;
+} tfx_upload;
+
+// uploads can be queued from any thread, they're issued in order while frames
+// execute until the budget for the frame runs out.
+static struct {
+	bool ready;
+	tfx_sem lock;
+	tfx_upload *queue;
+	uint32_t head;
+	uint32_t next_ticket;
+	// last ticket issued, written by whichever thread executes frames.
+	uint32_t completed;
+	uint32_t budget_bytes;
+	uint32_t budget_usec;
+} g_uploads;
+
+static void uploads_init() {
+	if (g_uploads.ready) {
+		return;
+	}
+	memset(&g_uploads, 0, sizeof(g_uploads));
+	// a semaphore with one count does fine as a lock.
+	tfx_sem_init(&g_uploads.lock, 1);
+	g_uploads.budget_bytes = TFX_UPLOAD_BUDGET_BYTES;
+	g_uploads.budget_usec = TFX_UPLOAD_BUDGET_USEC;
+	g_uploads.ready = true;
+}
+
+static void uploads_free() {
+	if (!g_uploads.ready) {
+		return;
+	}
+	int nu = sb_count(g_uploads.queue);
+	for (int i = g_uploads.head; i < nu; i++) {
+		free(g_uploads.queue[i].data);
+	}
+	sb_free(g_uploads.queue);
+	tfx_sem_free(&g_uploads.lock);
+	memset(&g_uploads, 0, sizeof(g_uploads));
+}
+
+// every distinct uniform name gets an id, so staging values can index by it
+// instead of comparing names. names are copied, and found through an open
+// addressed table of id + 1 (zero is empty). ids stay valid until shutdown.
+static struct {
+	char **names;
+	uint32_t *table;
+	uint32_t capacity;
+} g_uniform_names;
+
+static uint32_t uniform_hash(const char *name) {
+	// fnv-1a
+	uint32_t h = 2166136261u;
+	for (const char *c = name; *c; c++) {
+		h = (h ^ (uint8_t)*c) * 16777619u;
+	}
+	return h;
+}
+
+static void uniform_names_insert(uint32_t id) {
+	uint32_t mask = g_uniform_names.capacity - 1;
+	uint32_t at = uniform_hash(g_uniform_names.names[id]) & mask;
+	while (g_uniform_names.table[at] != 0) {
+		at = (at + 1) & mask;
+	}
+	g_uniform_names.table[at] = id + 1;
+}
+
+static uint32_t uniform_id(const char *name) {
+	if (g_uniform_names.capacity > 0) {
+		uint32_t mask = g_uniform_names.capacity - 1;
+		uint32_t at = uniform_hash(name) & mask;
+		while (g_uniform_names.table[at] != 0) {
+			uint32_t id = g_uniform_names.table[at] - 1;
+			if (strcmp(g_uniform_names.names[id], name) == 0) {
+				return id;
+			}
+			at = (at + 1) & mask;
+		}
+	}
+
+	uint32_t id = (uint32_t)sb_count(g_uniform_names.names);
+	sb_push(g_uniform_names.names, tfx_strdup(name));
+
+	// keep the table at most half full, rehashing everything when it grows.
+	if ((id + 1) * 2 > g_uniform_names.capacity) {
+		free(g_uniform_names.table);
+		g_uniform_names.capacity = g_uniform_names.capacity ? g_uniform_names.capacity * 2 : 64;
+		g_uniform_names.table = calloc(g_uniform_names.capacity, sizeof(uint32_t));
+		for (uint32_t i = 0; i < id; i++) {
+			uniform_names_insert(i);
+		}
+	}
+	uniform_names_insert(id);
+	return id;
+}
+
+static void uniform_names_free() {
+	int n = sb_count(g_uniform_names.names);
+	for (int i = 0; i < n; i++) {
+		free(g_uniform_names.names[i]);
+	}
+	sb_free(g_uniform_names.names);
+	free(g_uniform_names.table);
+	memset(&g_uniform_names, 0, sizeof(g_uniform_names));
+}
+
+// blits and copies are kept allocated between frames, these are the only
+// view members which need freeing.
+static void views_free_lists(tfx_view *views) {
+	for (int i = 0; i < VIEW_MAX; i++) {
+		sb_free(views[i].blits);
+		views[i].blits = NULL;
+		sb_free(views[i].copies);
+		views[i].copies = NULL;
+	}
+}
+
+static const char *g_debug_attribs[] = { "v_position", NULL };
+static bool did_you_call_tfx_reset = false;
+
+void tfx_reset(uint16_t width, uint16_t height, tfx_reset_flags flags) {
+	if (g_platform_data.gl_get_proc_address != NULL) {
+		load_em_up(g_platform_data.gl_get_proc_address);
+	}
+
+	did_you_call_tfx_reset = true;
+	uploads_init();
+
+	g_caps = tfx_get_caps();
+	// we require these, unless/until backporting for pre-compute HW.
+	assert(g_caps.instancing);
+	assert(g_caps.compute);
+
+	g_flags = TFX_RESET_NONE;
+	if (g_caps.anisotropic_filtering && (flags & TFX_RESET_MAX_ANISOTROPY) == TFX_RESET_MAX_ANISOTROPY) {
 		g_flags |= TFX_RESET_MAX_ANISOTROPY;
 	}
 
@@ -1040,9 +2118,36 @@ void tfx_reset(uint16_t width, uint16_t height, tfx_reset_flags flags) {
 		use_timers = true;
 	}
 
+	if ((flags & TFX_RESET_RENDER_THREAD) == TFX_RESET_RENDER_THREAD) {
+		g_flags |= TFX_RESET_RENDER_THREAD;
+		if (!g_render_thread) {
+			// nothing is in flight yet, so the render thread starts out idle.
+			tfx_sem_init(&g_render_ready, 0);
+			tfx_sem_init(&g_render_done, 1);
+			memset(&g_render_stats, 0, sizeof(tfx_stats));
+			g_render_quit = false;
+			g_render_thread = true;
+		}
+	}
+
+	bool use_ring = (flags & TFX_RESET_UNIFORM_BUFFERS) == TFX_RESET_UNIFORM_BUFFERS;
+	if (use_ring != (g_uniform_ring.ptr != NULL)) {
+		// uniform locations and blocks are resolved differently, start over.
+		program_info_clear();
+		uniform_ring_free();
+		if (use_ring && !uniform_ring_init()) {
+			TFX_WARN("%s", "Uniform buffers are not supported, falling back to glUniform.");
+		}
+	}
+	if (g_uniform_ring.ptr) {
+		g_flags |= TFX_RESET_UNIFORM_BUFFERS;
+	}
+
 	if (g_debug_data != NULL) {
 		free(g_debug_data);
 		g_debug_data = NULL;
+		free(g_debug_staged);
+		g_debug_staged = NULL;
 	}
 	if (g_debug_overlay.gl_count > 0) {
 		tfx_texture_free(&g_debug_overlay);
@@ -1074,6 +2179,7 @@ void tfx_reset(uint16_t width, uint16_t height, tfx_reset_flags flags) {
 		oh += oh % 8;
 		size_t mem = (size_t)ow * oh * 4;
 		g_debug_data = malloc(mem);
+		g_debug_staged = malloc(mem);
 		g_debug_overlay = tfx_texture_new(ow, oh, 1, NULL, TFX_FORMAT_RGBA8, TFX_TEXTURE_CPU_WRITABLE | TFX_TEXTURE_FILTER_POINT);
 	}
 
@@ -1088,21 +2194,11 @@ void tfx_reset(uint16_t width, uint16_t height, tfx_reset_flags flags) {
 	g_backbuffer.attachments[0].height = height;
 	g_backbuffer.attachments[0].depth = 1;
 
-	if (!g_back.uniform_buffer) {
-		g_back.uniform_buffer = (uint8_t*)malloc(TFX_UNIFORM_BUFFER_SIZE);
-		memset(g_back.uniform_buffer, 0, TFX_UNIFORM_BUFFER_SIZE);
-		g_back.ub_cursor = g_back.uniform_buffer;
-	}
-
-	if (!g_transient_buffer.data) {
-		g_transient_buffer.data = (uint8_t*)malloc(TFX_TRANSIENT_BUFFER_SIZE);
-		memset(g_transient_buffer.data, 0xfc, TFX_TRANSIENT_BUFFER_SIZE);
+	if (!g_back.transient.size) {
 		tvb_reset();
 	}
-
-	if (!g_back.uniform_map) {
-		g_back.uniform_map = tfx_progmap_new();
-	}
+	g_back.transient.offset = 0;
+	g_back.transient_indices.offset = 0;
 
 	// update every already loaded texture's anisotropy to max (typically 16) or 0
 	if (g_caps.anisotropic_filtering) {
@@ -1110,6 +2206,9 @@ void tfx_reset(uint16_t width, uint16_t height, tfx_reset_flags flags) {
 		if (g_max_aniso > 0.0f) {
 			for (int i = 0; i < nt; i++) {
 				tfx_texture *tex = &g_textures[i];
+				if (!tex->id) {
+					continue;
+				}
 				for (unsigned j = 0; j < tex->gl_count; j++) {
 					if ((tex->flags & TFX_TEXTURE_MSAA_SAMPLE) == TFX_TEXTURE_MSAA_SAMPLE) {
 						continue;
@@ -1137,6 +2236,8 @@ void tfx_reset(uint16_t width, uint16_t height, tfx_reset_flags flags) {
 	}
 #endif
 
+	// the front views aren't touched, a frame may still be using them.
+	views_free_lists(g_back.views);
 	memset(&g_back.views, 0, sizeof(tfx_view)*VIEW_MAX);
 
 	// not supported in ES2 w/o exts
@@ -1156,6 +2257,14 @@ void tfx_reset(uint16_t width, uint16_t height, tfx_reset_flags flags) {
 }
 
 void tfx_shutdown() {
+	if (g_render_thread) {
+		// the app has stopped (see tfx_render_stop), so anything recorded
+		// since the last frame can just be flushed from here.
+		g_render_thread = false;
+		tfx_sem_free(&g_render_ready);
+		tfx_sem_free(&g_render_done);
+	}
+
 	tfx_frame();
 
 	if (tfx_glQueryCounter && g_timers[0] != 0) {
@@ -1163,47 +2272,104 @@ void tfx_shutdown() {
 	}
 
 	// TODO: clean up all GL objects, allocs, etc.
-	free(g_back.uniform_buffer);
-	g_back.uniform_buffer = NULL;
-
-	free(g_transient_buffer.data);
-	g_transient_buffer.data = NULL;
+	for (int i = 0; i < TFX_ENCODER_MAX+1; i++) {
+		encoder_free(&g_back.encoders[i]);
+		encoder_free(&g_front.encoders[i]);
+	}
+
+	views_free_lists(g_back.views);
+	views_free_lists(g_front.views);
+	sb_free(g_clear_fill);
+	g_clear_fill = NULL;
+
+	sb_free(g_back.buffer_updates);
+	sb_free(g_back.update_data);
+	sb_free(g_back.texture_updates);
+	sb_free(g_front.buffer_updates);
+	sb_free(g_front.update_data);
+	sb_free(g_front.texture_updates);
+	g_back.buffer_updates = NULL;
+	g_back.update_data = NULL;
+	g_back.texture_updates = NULL;
+	g_front.buffer_updates = NULL;
+	g_front.update_data = NULL;
+	g_front.texture_updates = NULL;
+
+	// the last frames released any freed bundles already.
+	sb_free(g_back.bundle_frees);
+	sb_free(g_front.bundle_frees);
+	g_back.bundle_frees = NULL;
+	g_front.bundle_frees = NULL;
+
+	tvb_free(&g_back.transient);
+	tvb_free(&g_front.transient);
+	tvb_free(&g_back.transient_indices);
+	tvb_free(&g_front.transient_indices);
+	for (int i = 0; i < 33; i++) {
+		free(g_transient_buffer.sinks[i]);
+		g_transient_buffer.sinks[i] = NULL;
+	}
 
 	for (int i = 0; i < TFX_TRANSIENT_BUFFER_COUNT; i++) {
-		if (g_transient_buffer.buffers[i].gl_id) {
-			tfx_glDeleteBuffers(1, &g_transient_buffer.buffers[i].gl_id);
+		if (g_transient_buffer.fences[i]) {
+			CHECK(tfx_glDeleteSync(g_transient_buffer.fences[i]));
+		}
+		for (int j = 0; j < TFX_TRANSIENT_CHUNK_MAX; j++) {
+			if (g_transient_buffer.buffers[i][j].gl_id) {
+				tfx_glDeleteBuffers(1, &g_transient_buffer.buffers[i][j].gl_id);
+			}
+			if (g_transient_buffer.indices[i][j].gl_id) {
+				tfx_glDeleteBuffers(1, &g_transient_buffer.indices[i][j].gl_id);
+			}
 		}
 	}
+	memset(&g_transient_buffer, 0, sizeof(g_transient_buffer));
 
-	if (g_back.uniform_map) {
-		tfx_progmap_delete(g_back.uniform_map);
-		g_back.uniform_map = NULL;
-	}
-
-	// this can happen if you shutdown before calling frame()
-	if (g_back.uniforms) {
-		sb_free(g_back.uniforms);
-		g_back.uniforms = NULL;
-	}
+	sb_free(g_sort_items);
+	g_sort_items = NULL;
+	sb_free(g_sort_scratch);
+	g_sort_scratch = NULL;
 
 	int nt = sb_count(g_textures);
 	while (nt-- > 0) {
-		tfx_texture_free(&g_textures[nt]);
+		if (g_textures[nt].id) {
+			tfx_texture_free(&g_textures[nt]);
+		}
 	}
 	sb_free(g_textures);
+	g_textures = NULL;
+	slots_free(&g_texture_slots);
 
 	int nb = sb_count(g_buffers);
 	while (nb-- > 0) {
-		tfx_buffer_free(&g_buffers[nb]);
+		if (g_buffers[nb].id) {
+			tfx_buffer_free(&g_buffers[nb]);
+		}
 	}
 	sb_free(g_buffers);
+	g_buffers = NULL;
+	slots_free(&g_buffer_slots);
+
+	uniform_ring_free();
+	uploads_free();
+	heap_free_all();
+	vao_free_all();
+	indirect_free();
 
 	tfx_glUseProgram(0);
 	int np = sb_count(g_programs);
 	for (int i = 0; i < np; i++) {
 		tfx_glDeleteProgram(g_programs[i]);
 	}
+	program_info_clear();
+	uniform_names_free();
+	// both are gone now, make the next reset create them again.
+	memset(&g_debug_texture, 0, sizeof(tfx_uniform));
+	g_debug_program = 0;
 	sb_free(g_programs);
+	sb_free(g_program_info);
+	g_programs = NULL;
+	g_program_info = NULL;
 
 #ifdef TFX_LEAK_CHECK
 	stb_leakcheck_dumpmem();
@@ -1409,6 +2575,11 @@ static GLuint load_shader(GLenum type, const char *shaderSrc, const int len) {
 	return shader;
 }
 
+// locations are looked up as uniforms get used with the program.
+static void add_program(tfx_program program) {
+	sb_push(g_programs, program);
+}
+
 static bool try_program_link(GLuint program) {
 	CHECK(tfx_glLinkProgram(program));
 	GLint linked;
@@ -1488,7 +2659,7 @@ tfx_program tfx_program_gs_len_new(const char *_gss, const int _gs_len, const ch
 	CHECK(tfx_glDeleteShader(vs));
 	CHECK(tfx_glDeleteShader(fs));
 
-	sb_push(g_programs, program);
+	add_program(program);
 
 	return program;
 }
@@ -1528,7 +2699,7 @@ tfx_program tfx_program_cs_len_new(const char *css, const int cs_len) {
 	}
 	CHECK(tfx_glDeleteShader(cs));
 
-	sb_push(g_programs, program);
+	add_program(program);
 
 	return program;
 }
@@ -1577,6 +2748,10 @@ size_t tfx_vertex_format_offset(tfx_vertex_format *fmt, uint8_t slot) {
 	return fmt->components[slot].offset;
 }
 
+void tfx_vertex_format_set_divisor(tfx_vertex_format *fmt, uint8_t divisor) {
+	fmt->divisor = divisor;
+}
+
 void tfx_vertex_format_end(tfx_vertex_format *fmt) {
 	size_t stride = 0;
 	int nc = fmt->count;
@@ -1602,7 +2777,7 @@ tfx_buffer tfx_buffer_new(const void *data, size_t size, tfx_vertex_format *form
 	assert(did_you_call_tfx_reset);
 
 	GLenum gl_usage = GL_STATIC_DRAW;
-	switch (flags) {
+	switch (flags & ~TFX_BUFFER_SUBALLOCATE) {
 		case TFX_BUFFER_MUTABLE: gl_usage = GL_DYNAMIC_DRAW; break;
 		//case TFX_BUFFER_STREAM:  gl_usage = GL_STREAM_DRAW; break;
 		default: break;
@@ -1620,77 +2795,91 @@ tfx_buffer tfx_buffer_new(const void *data, size_t size, tfx_vertex_format *form
 		buffer.format = *format;
 	}
 
-	CHECK(tfx_glGenBuffers(1, &buffer.gl_id));
-	CHECK(tfx_glBindBuffer(GL_ARRAY_BUFFER, buffer.gl_id));
+	buffer.size = (uint32_t)size;
+	bool heap = false;
+	if ((flags & TFX_BUFFER_SUBALLOCATE) == TFX_BUFFER_SUBALLOCATE) {
+		heap = heap_alloc(buffer.size, buffer.has_format ? (uint32_t)buffer.format.stride : 0, &buffer.gl_id, &buffer.offset);
+	}
+	if (heap) {
+		if (data) {
+			CHECK(tfx_glBindBuffer(GL_ARRAY_BUFFER, buffer.gl_id));
+			CHECK(tfx_glBufferSubData(GL_ARRAY_BUFFER, buffer.offset, size, data));
+		}
+	}
+	else {
+		CHECK(tfx_glGenBuffers(1, &buffer.gl_id));
+		CHECK(tfx_glBindBuffer(GL_ARRAY_BUFFER, buffer.gl_id));
+	}
 
-	if (size != 0) {
+	if (size != 0 && !heap) {
 		if (tfx_glBufferStorage) {
-			CHECK(tfx_glBufferStorage(GL_ARRAY_BUFFER, size, data, (gl_usage == GL_DYNAMIC_DRAW ? (GL_DYNAMIC_STORAGE_BIT | GL_MAP_WRITE_BIT) : 0)))
+			GLbitfield storage = 0;
+			if (gl_usage == GL_DYNAMIC_DRAW) {
+				storage = GL_DYNAMIC_STORAGE_BIT | GL_MAP_WRITE_BIT;
+			}
+			else {
+				// the contents may come later, from tfx_buffer_upload.
+				storage = GL_DYNAMIC_STORAGE_BIT;
+			}
+			CHECK(tfx_glBufferStorage(GL_ARRAY_BUFFER, size, data, storage));
 		}
 		else {
 			CHECK(tfx_glBufferData(GL_ARRAY_BUFFER, size, data, gl_usage));
 		}
 	}
 
-	sb_push(g_buffers, buffer);
+	buffer.id = slot_alloc(&g_buffer_slots);
+	int slot = buffer.id & TFXI_SLOT_MASK;
+	if (slot == sb_count(g_buffers)) {
+		sb_push(g_buffers, buffer);
+	}
+	else {
+		g_buffers[slot] = buffer;
+	}
 
 	return buffer;
 }
 
-typedef struct tfx_buffer_params {
-	uint32_t offset;
-	uint32_t size;
-	const void *update_data;
-} tfx_buffer_params;
-
-static tfx_buffer *get_internal_buffer(tfx_buffer *buf) {
-	int nb = sb_count(g_buffers);
-	for (int i = 0; i < nb; i++) {
-		if (g_buffers[i].gl_id == buf->gl_id) {
-			return &g_buffers[i];
-		}
-	}
-	return NULL;
-}
-
+// updates are copied straight into the frame being recorded, and merged into
+// as few mapped ranges as possible before drawing.
 void tfx_buffer_update(tfx_buffer *buf, const void *data, uint32_t offset, uint32_t size) {
 	assert(buf != NULL);
 	assert((buf->flags & TFX_BUFFER_MUTABLE) == TFX_BUFFER_MUTABLE);
 	assert(size > 0);
 	assert(data != NULL);
-	tfx_buffer_params *params = buf->internal;
-	if (!buf->internal) {
-		params = calloc(1, sizeof(tfx_buffer_params));
-	}
-	params->update_data = data;
-	params->offset = offset;
-	params->size = size;
-	get_internal_buffer(buf)->internal = params;
+	assert(offset + size <= buf->size);
+	tfx_buffer_update_op update;
+	update.id = buf->id;
+	update.gl_id = buf->gl_id;
+	update.offset = buf->offset + offset;
+	update.size = size;
+	update.data = (uint32_t)sb_count(g_back.update_data);
+	update.seq = (uint32_t)sb_count(g_back.buffer_updates);
+	memcpy(sb_add(g_back.update_data, size), data, size);
+	sb_push(g_back.buffer_updates, update);
 }
 
 void tfx_buffer_free(tfx_buffer *buf) {
-	CHECK(tfx_glDeleteBuffers(1, &buf->gl_id));
-	if (buf->internal) {
-		free(buf->internal);
-		buf->internal = NULL;
+	// already freed, possibly through another copy.
+	int slot = slot_find(&g_buffer_slots, buf->id);
+	if (slot < 0) {
+		return;
 	}
-	int nb = sb_count(g_buffers);
-	for (int i = 0; i < nb; i++) {
-		tfx_buffer *cached = &g_buffers[i];
-		// we only need to check index 0, as these ids cannot overlap or be reused.
-		if (buf->gl_id == cached->gl_id) {
-			g_buffers[i] = g_buffers[nb - 1];
-			// this, uh, might not be right.
-			stb__sbraw(g_buffers)[1] -= 1;
-		}
+
+	// updates still queued for it are dropped when their frame executes.
+	tfx_buffer *stored = &g_buffers[slot];
+	if ((stored->flags & TFX_BUFFER_SUBALLOCATE) != TFX_BUFFER_SUBALLOCATE || !heap_release(stored->gl_id, stored->offset, stored->size)) {
+		vao_forget(stored->gl_id);
+		CHECK(tfx_glDeleteBuffers(1, &stored->gl_id));
 	}
+	memset(&g_buffers[slot], 0, sizeof(tfx_buffer));
+	slot_release(&g_buffer_slots, slot);
 }
 
 typedef struct tfx_texture_params {
 	GLenum format;
 	GLenum internal_format;
 	GLenum type;
-	const void *update_data;
 } tfx_texture_params;
 
 tfx_texture tfx_texture_new(uint16_t w, uint16_t h, uint16_t layers, const void *data, tfx_format format, uint16_t flags) {
@@ -1727,7 +2916,6 @@ tfx_texture tfx_texture_new(uint16_t w, uint16_t h, uint16_t layers, const void
 	t.gl_idx = 0;
 
 	tfx_texture_params *params = calloc(1, sizeof(tfx_texture_params));
-	params->update_data = NULL;
 
 	// TODO: add some stencil formats (i.e. D24S8)
 	bool stencil = false;
@@ -1987,31 +3175,118 @@ tfx_texture tfx_texture_new(uint16_t w, uint16_t h, uint16_t layers, const void
 		}
 	}
 
-	sb_push(g_textures, t);
+	t.id = slot_alloc(&g_texture_slots);
+	int slot = t.id & TFXI_SLOT_MASK;
+	if (slot == sb_count(g_textures)) {
+		sb_push(g_textures, t);
+	}
+	else {
+		g_textures[slot] = t;
+	}
 
 	return t;
 }
 
+// queued into the frame like buffer updates. the texture is only looked up
+// when the frame executes, textures may be created and freed meanwhile.
 void tfx_texture_update(tfx_texture *tex, const void *data) {
 	assert((tex->flags & TFX_TEXTURE_CPU_WRITABLE) == TFX_TEXTURE_CPU_WRITABLE);
-	tfx_texture_params *internal = tex->internal;
-	internal->update_data = data;
+	tfx_texture_update_op update;
+	update.id = tex->id;
+	update.data = data;
+	sb_push(g_back.texture_updates, update);
 }
 
 void tfx_texture_free(tfx_texture *tex) {
-	int nt = sb_count(g_textures);
-	for (int i = 0; i < nt; i++) {
-		tfx_texture *cached = &g_textures[i];
-		// we only need to check index 0, as these ids cannot overlap or be reused.
-		if (tex->gl_ids[0] == cached->gl_ids[0]) {
-			tfx_texture_params *internal = (tfx_texture_params*)cached->internal;
-			free(internal);
-			tfx_glDeleteTextures(cached->gl_count, cached->gl_ids);
-			g_textures[i] = g_textures[nt-1];
-			// this, uh, might not be right.
-			stb__sbraw(g_textures)[1] -= 1;
-		}
+	// already freed, possibly through another copy.
+	int slot = slot_find(&g_texture_slots, tex->id);
+	if (slot < 0) {
+		return;
 	}
+	tfx_texture *cached = &g_textures[slot];
+	free(cached->internal);
+	tfx_glDeleteTextures(cached->gl_count, cached->gl_ids);
+	memset(cached, 0, sizeof(tfx_texture));
+	slot_release(&g_texture_slots, slot);
+}
+
+static uint32_t upload_push(tfx_upload upload, const void *data) {
+	assert(g_uploads.ready);
+	// copy outside the lock, it's the slow part.
+	upload.data = malloc(upload.size);
+	memcpy(upload.data, data, upload.size);
+
+	tfx_sem_wait(&g_uploads.lock);
+	upload.ticket = ++g_uploads.next_ticket;
+	sb_push(g_uploads.queue, upload);
+	tfx_sem_post(&g_uploads.lock);
+	return upload.ticket;
+}
+
+// bytes per pixel of client data for a texture, as glTexSubImage reads it.
+static uint32_t texture_pixel_size(tfx_texture_params *params) {
+	switch (params->type) {
+		case GL_UNSIGNED_SHORT_5_6_5: return 2;
+		case GL_UNSIGNED_INT_10_10_10_2: return 4;
+		default: break;
+	}
+	uint32_t components = 4;
+	switch (params->format) {
+		case GL_RED:
+		case GL_DEPTH_COMPONENT: components = 1; break;
+		case GL_RG: components = 2; break;
+		case GL_RGB: components = 3; break;
+		default: break;
+	}
+	return components * (params->type == GL_UNSIGNED_BYTE ? 1 : 4);
+}
+
+// bytes of client data for a whole 2D mip level.
+static uint32_t texture_mip_size(tfx_texture *tex, uint16_t mip) {
+	uint32_t w = tex->width >> mip;
+	uint32_t h = tex->height >> mip;
+	return (w ? w : 1) * (h ? h : 1) * texture_pixel_size(tex->internal);
+}
+
+uint32_t tfx_buffer_upload(tfx_buffer *buf, const void *data, uint32_t offset, uint32_t size) {
+	assert(buf != NULL);
+	assert(data != NULL);
+	assert(size > 0);
+	tfx_upload upload;
+	memset(&upload, 0, sizeof(tfx_upload));
+	assert(offset + size <= buf->size);
+	upload.id = buf->id;
+	upload.offset = buf->offset + offset;
+	upload.size = size;
+	return upload_push(upload, data);
+}
+
+uint32_t tfx_texture_upload(tfx_texture *tex, uint16_t mip, const void *data, uint32_t size) {
+	assert(tex != NULL);
+	assert(data != NULL);
+	assert(size > 0);
+	// only whole 2D mip levels, CPU writable textures have tfx_texture_update.
+	assert((tex->flags & (TFX_TEXTURE_CUBE | TFX_TEXTURE_CPU_WRITABLE)) == 0);
+	assert(tex->depth <= 1);
+	assert(mip < tex->mip_count);
+	assert(size == texture_mip_size(tex, mip));
+	tfx_upload upload;
+	memset(&upload, 0, sizeof(tfx_upload));
+	upload.id = tex->id;
+	upload.texture = true;
+	upload.mip = mip;
+	upload.size = size;
+	return upload_push(upload, data);
+}
+
+bool tfx_upload_done(uint32_t ticket) {
+	uint32_t completed = tfx_atomic_add(&g_uploads.completed, 0);
+	return (int32_t)(completed - ticket) >= 0;
+}
+
+void tfx_set_upload_budget(uint32_t bytes_per_frame, uint32_t usec_per_frame) {
+	g_uploads.budget_bytes = bytes_per_frame;
+	g_uploads.budget_usec = usec_per_frame;
 }
 
 bool canvas_reconfigure(tfx_canvas *c, bool msaa) {
@@ -2272,7 +3547,9 @@ tfx_uniform tfx_uniform_new(const char *name, tfx_uniform_type type, int count)
 	tfx_uniform u;
 	memset(&u, 0, sizeof(tfx_uniform));
 
-	u.name  = name;
+	u.id    = uniform_id(name);
+	// the copy, so the caller's string doesn't need to outlive the frame.
+	u.name  = g_uniform_names.names[u.id];
 	u.type  = type;
 	u.count = count;
 	u.last_count = count;
@@ -2281,38 +3558,55 @@ tfx_uniform tfx_uniform_new(const char *name, tfx_uniform_type type, int count)
 	return u;
 }
 
-void tfx_set_uniform(tfx_uniform *uniform, const float *data, const int count) {
+// copies the value into the encoder, the caller's uniform is left untouched so
+// it can be shared between threads.
+static void stage_uniform(tfx_encoder *enc, tfx_uniform *uniform, const void *data, const int count) {
 	size_t size = uniform->size;
-	uniform->last_count = uniform->count;
+	int last_count = uniform->count;
 	if (count >= 0) {
 		size = count * uniform_size_for(uniform->type);
-		uniform->last_count = count;
+		last_count = count;
 	}
 
-	uniform->data = g_back.ub_cursor;
-	uint32_t offset = (g_back.ub_cursor + size - g_back.uniform_buffer);
-	assert(offset < TFX_UNIFORM_BUFFER_SIZE);
-	memcpy(uniform->fdata, data, size);
-	g_back.ub_cursor += size;
-
-	sb_push(g_back.uniforms, *uniform);
-}
+	uint32_t id = uniform->id;
+	int have = sb_count(enc->uniform_slots);
+	if ((int)id >= have) {
+		int *added = sb_add(enc->uniform_slots, id + 1 - have);
+		memset(added, 0, sizeof(int) * (id + 1 - have));
+	}
 
-void tfx_set_uniform_int(tfx_uniform *uniform, const int *data, const int count) {
-	size_t size = uniform->size;
-	uniform->last_count = uniform->count;
-	if (count >= 0) {
-		size = count * uniform_size_for(uniform->type);
-		uniform->last_count = count;
+	// only keep the last update for a given uniform
+	int slot = enc->uniform_slots[id];
+	if (slot > 0) {
+		tfx_uniform *live = &enc->uniforms[slot - 1];
+		// setting the same value again changes nothing, so the last snapshot still holds.
+		if (live->last_count == last_count && live->type == uniform->type && memcmp(live->data, data, size) == 0) {
+			return;
+		}
+		// earlier snapshots point at the old value, so it can't be written over.
+		*live = *uniform;
+		live->last_count = last_count;
+		live->data = encoder_alloc(enc, size);
+		memcpy(live->data, data, size);
+		enc->uniforms_dirty = true;
+		return;
 	}
 
-	uniform->data = g_back.ub_cursor;
-	uint32_t offset = (g_back.ub_cursor + size - g_back.uniform_buffer);
-	assert(offset < TFX_UNIFORM_BUFFER_SIZE);
-	memcpy(uniform->idata, data, size);
-	g_back.ub_cursor += size;
+	tfx_uniform staged = *uniform;
+	staged.last_count = last_count;
+	staged.data = encoder_alloc(enc, size);
+	memcpy(staged.data, data, size);
+	sb_push(enc->uniforms, staged);
+	enc->uniform_slots[id] = sb_count(enc->uniforms);
+	enc->uniforms_dirty = true;
+}
+
+void tfx_encoder_set_uniform(tfx_encoder *enc, tfx_uniform *uniform, const float *data, const int count) {
+	stage_uniform(enc, uniform, data, count);
+}
 
-	sb_push(g_back.uniforms, *uniform);
+void tfx_encoder_set_uniform_int(tfx_encoder *enc, tfx_uniform *uniform, const int *data, const int count) {
+	stage_uniform(enc, uniform, data, count);
 }
 
 void tfx_view_set_flags(uint8_t id, tfx_view_flags flags) {
@@ -2324,10 +3618,30 @@ void tfx_view_set_flags(uint8_t id, tfx_view_flags flags) {
 	if (FLAG(flags, TFX_VIEW_FLUSH)) {
 		view->flags |= TFXI_VIEW_FLUSH;
 	}
-	// NYI
+
+	// sort modes are exclusive, setting one replaces the last.
+	uint32_t sort = 0;
+	int sort_count = 0;
 	if (FLAG(flags, TFX_VIEW_SORT_SEQUENTIAL)) {
-		assert(0);
-		view->flags |= TFXI_VIEW_SORT_SEQUENTIAL;
+		sort = TFXI_VIEW_SORT_SEQUENTIAL;
+		sort_count++;
+	}
+	if (FLAG(flags, TFX_VIEW_SORT_STATE)) {
+		sort = TFXI_VIEW_SORT_STATE;
+		sort_count++;
+	}
+	if (FLAG(flags, TFX_VIEW_SORT_FRONT_TO_BACK)) {
+		sort = TFXI_VIEW_SORT_FRONT_TO_BACK;
+		sort_count++;
+	}
+	if (FLAG(flags, TFX_VIEW_SORT_BACK_TO_FRONT)) {
+		sort = TFXI_VIEW_SORT_BACK_TO_FRONT;
+		sort_count++;
+	}
+	assert(sort_count <= 1);
+	if (sort_count > 0) {
+		view->flags &= ~TFXI_VIEW_SORT_MASK;
+		view->flags |= sort;
 	}
 #undef FLAG
 }
@@ -2472,37 +3786,110 @@ void tfx_view_set_scissor(uint8_t id, uint16_t x, uint16_t y, uint16_t w, uint16
 	view->scissor_rect = rect;
 }
 
-static tfx_draw g_tmp_draw;
+static void reset(tfx_encoder *enc) {
+	memset(&enc->tmp_draw, 0, sizeof(tfx_draw));
+	memset(&enc->tmp_bindings, 0, sizeof(tfx_bindings));
+	memset(&enc->tmp_format, 0, sizeof(tfx_vertex_format));
+	memset(&enc->tmp_instance_format, 0, sizeof(tfx_vertex_format));
+	enc->use_bindings = false;
+}
 
-static void reset() {
-	memset(&g_tmp_draw, 0, sizeof(tfx_draw));
+// the global tfx_set_*/tfx_submit functions record into this one.
+static tfx_encoder *default_encoder() {
+	return &g_back.encoders[0];
 }
 
-void tfx_set_callback(tfx_draw_callback cb) {
-	g_tmp_draw.callback = cb;
+tfx_encoder *tfx_encoder_begin(uint8_t slot) {
+	assert(slot < TFX_ENCODER_MAX);
+	tfx_encoder *enc = &g_back.encoders[slot + 1];
+	// each slot may only be used by one thread at a time.
+	assert(!enc->active);
+	enc->active = true;
+	return enc;
 }
 
-void tfx_set_scissor(uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
-	g_tmp_draw.use_scissor = true;
-	g_tmp_draw.scissor_rect.x = x;
-	g_tmp_draw.scissor_rect.y = y;
-	g_tmp_draw.scissor_rect.w = w;
-	g_tmp_draw.scissor_rect.h = h;
+void tfx_encoder_end(tfx_encoder *enc) {
+	assert(enc != NULL);
+	assert(enc->active);
+	assert(!enc->bundle);
+	reset(enc);
+	enc->active = false;
 }
 
-void tfx_set_texture(tfx_uniform *uniform, tfx_texture *tex, uint8_t slot) {
+tfx_encoder *tfx_bundle_begin() {
+	tfx_bundle *bundle = calloc(1, sizeof(tfx_bundle));
+	tfx_encoder *enc = &bundle->encoder;
+	enc->uniform_block = TFXI_NONE;
+	enc->active = true;
+	enc->bundle = true;
+	return enc;
+}
+
+tfx_bundle *tfx_bundle_end(tfx_encoder *enc) {
+	assert(enc != NULL);
+	assert(enc->active);
+	assert(enc->bundle);
+	reset(enc);
+	enc->active = false;
+	// the encoder is the first member.
+	return (tfx_bundle*)enc;
+}
+
+static void bundle_release(tfx_bundle *bundle) {
+	encoder_free(&bundle->encoder);
+	sb_free(bundle->keys);
+	free(bundle);
+}
+
+void tfx_bundle_free(tfx_bundle *bundle) {
+	assert(bundle != NULL);
+	assert(!bundle->encoder.active);
+	// a frame in flight may still be using it.
+	sb_push(g_back.bundle_frees, bundle);
+}
+
+void tfx_encoder_set_callback(tfx_encoder *enc, tfx_draw_callback cb) {
+	enc->tmp_draw.callback = cb;
+}
+
+void tfx_encoder_set_scissor(tfx_encoder *enc, uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
+	tfx_draw *draw = &enc->tmp_draw;
+	draw->use_scissor = true;
+	draw->scissor_rect.x = x;
+	draw->scissor_rect.y = y;
+	draw->scissor_rect.w = w;
+	draw->scissor_rect.h = h;
+}
+
+void tfx_encoder_set_texture(tfx_encoder *enc, tfx_uniform *uniform, tfx_texture *tex, uint8_t slot) {
 	assert(slot <= 8);
 	assert(uniform != NULL);
 	assert(uniform->count == 1);
 
-	uniform->data = g_back.ub_cursor;
-	uniform->idata[0] = slot;
-	g_back.ub_cursor += uniform->size;
-
-	sb_push(g_back.uniforms, *uniform);
+	int value = slot;
+	stage_uniform(enc, uniform, &value, 1);
 
 	assert(tex->gl_ids[tex->gl_idx] > 0);
-	g_tmp_draw.textures[slot] = *tex;
+
+	bool msaa_sample = (tex->flags & TFX_TEXTURE_MSAA_SAMPLE) == TFX_TEXTURE_MSAA_SAMPLE;
+	GLenum target = GL_TEXTURE_2D;
+	if ((tex->flags & TFX_TEXTURE_CUBE) == TFX_TEXTURE_CUBE) {
+		target = GL_TEXTURE_CUBE_MAP;
+	}
+	if (tex->depth > 1) {
+		assert(target != GL_TEXTURE_CUBE_MAP);
+		target = GL_TEXTURE_2D_ARRAY;
+	}
+	if (msaa_sample) {
+		target = GL_TEXTURE_2D_MULTISAMPLE;
+	}
+
+	tfx_bindings *b = &enc->tmp_bindings;
+	b->textures[slot] = tex->gl_ids[msaa_sample ? 1 : tex->gl_idx];
+	b->targets[slot] = target;
+	tfx_texture_params *internal = (tfx_texture_params*)tex->internal;
+	b->formats[slot] = internal ? internal->internal_format : 0;
+	enc->use_bindings = true;
 }
 
 tfx_texture tfx_get_texture(tfx_canvas *canvas, uint8_t index) {
@@ -2522,152 +3909,409 @@ tfx_texture tfx_get_texture(tfx_canvas *canvas, uint8_t index) {
 	return tex;
 }
 
-void tfx_set_state(uint64_t flags) {
-	g_tmp_draw.flags = flags;
+void tfx_encoder_set_state(tfx_encoder *enc, uint64_t flags) {
+	enc->tmp_draw.flags = flags;
 }
 
-void tfx_set_buffer(tfx_buffer *buf, uint8_t slot, bool write) {
+void tfx_encoder_set_buffer(tfx_encoder *enc, tfx_buffer *buf, uint8_t slot, bool write) {
 	assert(slot < 8);
 	assert(buf != NULL);
-	g_tmp_draw.ssbos[slot] = *buf;
-	g_tmp_draw.ssbo_write[slot] = write;
+	tfx_bindings *b = &enc->tmp_bindings;
+	b->buffers[slot] = buf->gl_id;
+	// suballocated buffers only bind their own range.
+	bool range = (buf->flags & TFX_BUFFER_SUBALLOCATE) == TFX_BUFFER_SUBALLOCATE;
+	b->buffer_offsets[slot] = range ? buf->offset : 0;
+	b->buffer_sizes[slot] = range ? buf->size : 0;
+	if (write) {
+		b->buffers_write |= 1 << slot;
+	}
+	else {
+		b->buffers_write &= ~(1 << slot);
+	}
+	enc->use_bindings = true;
 }
 
-void tfx_set_image(tfx_uniform *uniform, tfx_texture *tex, uint8_t slot, uint8_t mip, bool write) {
+void tfx_encoder_set_image(tfx_encoder *enc, tfx_uniform *uniform, tfx_texture *tex, uint8_t slot, uint8_t mip, bool write) {
 	assert(slot < 8);
 	assert(tex != NULL);
-	tfx_set_texture(uniform, tex, slot);
-	g_tmp_draw.textures_mip[slot] = mip;
-	g_tmp_draw.textures_write[slot] = write;
+	tfx_encoder_set_texture(enc, uniform, tex, slot);
+	tfx_bindings *b = &enc->tmp_bindings;
+	// images always bind the current texture, even for msaa.
+	b->textures[slot] = tex->gl_ids[tex->gl_idx];
+	b->mips[slot] = mip;
+	if (write) {
+		b->textures_write |= 1 << slot;
+	}
+	else {
+		b->textures_write &= ~(1 << slot);
+	}
 }
 
-// TODO: make this work for index buffers
-void tfx_set_transient_buffer(tfx_transient_buffer tb) {
+void tfx_encoder_set_transient_buffer(tfx_encoder *enc, tfx_transient_buffer tb) {
 	assert(tb.has_format);
-	g_tmp_draw.vbo = g_transient_buffer.buffers[0];
-	g_tmp_draw.use_vbo = true;
-	g_tmp_draw.use_tvb = true;
-	g_tmp_draw.tvb_fmt = tb.format;
-	g_tmp_draw.offset = tb.offset;
-	g_tmp_draw.indices = tb.num;
+	// transient data only lasts one frame.
+	assert(!enc->bundle);
+	tfx_draw *draw = &enc->tmp_draw;
+	// the buffer itself is picked when the frame executes.
+	draw->vbo = 0;
+	draw->use_vbo = true;
+	draw->use_tvb = true;
+	enc->tmp_format = tb.format;
+	draw->offset = tb.offset % TFX_TRANSIENT_BUFFER_SIZE;
+	draw->tvb_chunk = (uint8_t)(tb.offset / TFX_TRANSIENT_BUFFER_SIZE);
+	draw->base_vertex = 0;
+	if (!draw->use_ibo) {
+		draw->indices = tb.num;
+	}
 }
 
-void tfx_set_vertices(tfx_buffer *vbo, int count) {
+void tfx_encoder_set_transient_indices(tfx_encoder *enc, tfx_transient_buffer tb) {
+	assert(!tb.has_format);
+	assert(!enc->bundle);
+	tfx_draw *draw = &enc->tmp_draw;
+	draw->ibo = 0;
+	draw->index_32 = tb.index_32;
+	draw->use_ibo = true;
+	draw->use_tib = true;
+	draw->index_offset = tb.offset % TFX_TRANSIENT_INDEX_BUFFER_SIZE;
+	draw->tib_chunk = (uint8_t)(tb.offset / TFX_TRANSIENT_INDEX_BUFFER_SIZE);
+	draw->indices = tb.num;
+}
+
+void tfx_encoder_set_vertices(tfx_encoder *enc, tfx_buffer *vbo, int count) {
 	assert(vbo != NULL);
 	assert(vbo->has_format);
 
-	g_tmp_draw.vbo = *vbo;
-	g_tmp_draw.use_vbo = true;
-	if (!g_tmp_draw.use_ibo) {
-		g_tmp_draw.indices = count;
+	tfx_draw *draw = &enc->tmp_draw;
+	draw->vbo = vbo->gl_id;
+	draw->use_vbo = true;
+	draw->use_tvb = false;
+	// suballocated buffers are aligned to a whole vertex.
+	assert((vbo->offset % vbo->format.stride) == 0);
+	draw->base_vertex = vbo->offset / (uint32_t)vbo->format.stride;
+	enc->tmp_format = vbo->format;
+	if (!draw->use_ibo) {
+		draw->indices = count;
 	}
 }
 
-void tfx_set_indices(tfx_buffer *ibo, int count, int offset) {
-	g_tmp_draw.ibo = *ibo;
-	g_tmp_draw.use_ibo = true;
-	g_tmp_draw.offset = offset;
-	g_tmp_draw.indices = count;
+void tfx_encoder_set_instances(tfx_encoder *enc, int count) {
+	assert(count >= 0);
+	enc->tmp_draw.instances = count;
 }
 
-static void push_uniforms(tfx_program program, tfx_draw *add_state) {
-	tfx_set **found = tfx_set_new();
+void tfx_encoder_set_instance_buffer(tfx_encoder *enc, tfx_buffer *buf) {
+	assert(buf != NULL);
+	assert(buf->has_format);
+	assert(g_caps.instancing);
+	// instances have no base to offset by, so they need their own buffer. check
+	// the flag, a suballocation can land at offset 0 by chance.
+	assert((buf->flags & TFX_BUFFER_SUBALLOCATE) == 0);
 
-	int n = sb_count(g_back.uniforms);
-	for (int i = n-1; i >= 0; i--) {
-		tfx_uniform uniform = g_back.uniforms[i];
+	enc->tmp_draw.instance_vbo = buf->gl_id;
+	enc->tmp_instance_format = buf->format;
+}
 
-		tfx_shadermap *val = tfx_proglookup(g_back.uniform_map, program);
-		if (!val) {
-			val = tfx_progset(g_back.uniform_map, program);
-		}
-#ifdef TFX_DEBUG
-		assert(val);
-		assert(val->value);
-#endif
-		tfx_locmap **locmap = val->value;
-		tfx_locmap *locval = tfx_loclookup(locmap, uniform.name);
+void tfx_encoder_set_indices(tfx_encoder *enc, tfx_buffer *ibo, int count, int offset) {
+	tfx_draw *draw = &enc->tmp_draw;
+	draw->ibo = ibo->gl_id;
+	draw->index_32 = (ibo->flags & TFX_BUFFER_INDEX_32) == TFX_BUFFER_INDEX_32;
+	draw->use_ibo = true;
+	draw->use_tib = false;
+	draw->index_offset = ibo->offset + offset;
+	draw->indices = count;
+}
 
-		if (!locval) {
-			GLint loc = CHECK(tfx_glGetUniformLocation(program, uniform.name));
-			if (loc >= 0) {
-				locval = tfx_locset(locmap, uniform.name, loc);
-			}
-			else {
-				continue;
-			}
-		}
+// snapshot the encoder's current uniforms for a draw. the values themselves
+// stay put in the encoder's chunks, only the headers are copied, and only
+// when something changed since the last draw.
+// locations are resolved at frame time, so recording never touches GL.
+static void push_uniforms(tfx_encoder *enc, tfx_draw *add_state) {
+	int n = sb_count(enc->uniforms);
+	if (n == 0) {
+		add_state->uniforms = TFXI_NONE;
+		add_state->uniform_count = 0;
+		return;
+	}
+
+	if (enc->uniforms_dirty || enc->uniform_block == TFXI_NONE) {
+		enc->uniform_block = sb_count(enc->uniform_blocks);
+		tfx_uniform *dst = sb_add(enc->uniform_blocks, n);
+		memcpy(dst, enc->uniforms, sizeof(tfx_uniform) * n);
+		enc->uniforms_dirty = false;
+	}
 
-		// only record the last update for a given uniform
-		if (!tfx_slookup(found, uniform.name)) {
-			tfx_uniform found_uniform = uniform;
-			found_uniform.data = g_back.ub_cursor;
-			assert((g_back.ub_cursor + uniform.size - g_back.uniform_buffer) < TFX_UNIFORM_BUFFER_SIZE);
-			memcpy(found_uniform.data, uniform.data, uniform.size);
-			g_back.ub_cursor += uniform.size;
+	add_state->uniforms = enc->uniform_block;
+	add_state->uniform_count = n;
+}
+
+// vertex and instance formats may alternate, so the last two entries are checked.
+static uint32_t push_format(tfx_encoder *enc, tfx_vertex_format *fmt) {
+	int n = sb_count(enc->formats);
+	for (int i = n - 1; i >= 0 && i >= n - 2; i--) {
+		if (memcmp(&enc->formats[i], fmt, sizeof(tfx_vertex_format)) == 0) {
+			return i;
+		}
+	}
+	sb_push(enc->formats, *fmt);
+	return n;
+}
 
-			tfx_sset(found, uniform.name);
-			sb_push(add_state->uniforms, found_uniform);
+// point the draw at the encoder's side tables, adding entries only when the
+// previous draw's don't match.
+static void push_resources(tfx_encoder *enc, tfx_draw *add_state) {
+	add_state->encoder = enc->bundle ? 0 : (uint8_t)(enc - g_back.encoders);
+
+	add_state->bindings = TFXI_NONE;
+	if (enc->use_bindings) {
+		int n = sb_count(enc->bindings);
+		if (n == 0 || memcmp(&enc->bindings[n-1], &enc->tmp_bindings, sizeof(tfx_bindings)) != 0) {
+			sb_push(enc->bindings, enc->tmp_bindings);
+			n += 1;
 		}
+		add_state->bindings = n - 1;
+	}
+
+	add_state->format = TFXI_NONE;
+	if (add_state->use_vbo) {
+		add_state->format = push_format(enc, &enc->tmp_format);
+	}
+	add_state->instance_format = TFXI_NONE;
+	if (add_state->instance_vbo) {
+		add_state->instance_format = push_format(enc, &enc->tmp_instance_format);
 	}
 
-	tfx_set_delete(found);
+	push_uniforms(enc, add_state);
 }
 
-void tfx_dispatch(uint8_t id, tfx_program program, uint32_t x, uint32_t y, uint32_t z) {
-	tfx_view *view = &g_back.views[id];
-	g_tmp_draw.program = program;
+void tfx_encoder_dispatch(tfx_encoder *enc, uint8_t id, tfx_program program, uint32_t x, uint32_t y, uint32_t z) {
+	enc->tmp_draw.program = program;
 	assert(program != 0);
-	assert(view != NULL);
 	assert((x*y*z) > 0);
 
 	tfx_draw add_state;
-	memcpy(&add_state, &g_tmp_draw, sizeof(tfx_draw));
+	memcpy(&add_state, &enc->tmp_draw, sizeof(tfx_draw));
 	add_state.threads_x = x;
 	add_state.threads_y = y;
 	add_state.threads_z = z;
 
-	push_uniforms(program, &add_state);
-	sb_push(view->jobs, add_state);
+	push_resources(enc, &add_state);
+	sb_push(enc->jobs[enc->bundle ? 0 : id], add_state);
 
-	reset();
+	reset(enc);
 }
 
-void tfx_submit(uint8_t id, tfx_program program, bool retain) {
-	tfx_view *view = &g_back.views[id];
-	g_tmp_draw.program = program;
-	assert(program != 0);
-	assert(view != NULL);
+void tfx_encoder_dispatch_indirect(tfx_encoder *enc, uint8_t id, tfx_program program, tfx_buffer *args, uint32_t offset) {
+	assert(args != NULL);
+	assert((offset % 4) == 0);
 
-	tfx_draw add_state;
-	memcpy(&add_state, &g_tmp_draw, sizeof(tfx_draw));
-	push_uniforms(program, &add_state);
-	sb_push(view->draws, add_state);
+	tfx_draw *draw = &enc->tmp_draw;
+	draw->indirect = args->gl_id;
+	draw->indirect_offset = args->offset + offset;
+	draw->indirect_count = 1;
+	// the real group counts are only known to the GPU.
+	tfx_encoder_dispatch(enc, id, program, 1, 1, 1);
+}
 
-	if (!retain) {
-		reset();
+// fold the bound texture set down to 16 bits, so draws sharing textures sort together.
+static uint16_t texture_set_key(tfx_bindings *bindings) {
+	uint32_t hash = 2166136261u;
+	for (int i = 0; i < 8; i++) {
+		hash ^= bindings->textures[i];
+		hash *= 16777619u;
 	}
+	return (uint16_t)(hash ^ (hash >> 16));
 }
 
-void tfx_submit_ordered(uint8_t id, tfx_program program, uint32_t depth, bool retain) {
-	g_tmp_draw.depth = depth;
-	tfx_submit(id, program, retain);
+// sort key layouts, most significant bits first:
+// state:         program (16) | textures (16) | state flags (16) | depth (16)
+// front to back: depth (32)   | program (16)  | textures (16)
+// back to front: ~depth (32)  | program (16)  | textures (16)
+// sequential views never sort, so they don't need a key.
+static uint64_t sort_key(uint32_t mode, tfx_bindings *bindings, tfx_draw *draw) {
+	uint64_t program = draw->program & 0xffff;
+	uint64_t textures = texture_set_key(bindings);
+	switch (mode) {
+		case TFXI_VIEW_SORT_STATE: {
+			uint64_t flags = draw->flags & 0xffff;
+			uint64_t depth = draw->depth >> 16;
+			return (program << 48) | (textures << 32) | (flags << 16) | depth;
+		}
+		case TFXI_VIEW_SORT_FRONT_TO_BACK: {
+			return ((uint64_t)draw->depth << 32) | (program << 16) | textures;
+		}
+		case TFXI_VIEW_SORT_BACK_TO_FRONT: {
+			return ((uint64_t)(~draw->depth) << 32) | (program << 16) | textures;
+		}
+		default: return 0;
+	}
 }
 
-void tfx_touch(uint8_t id) {
+void tfx_encoder_submit(tfx_encoder *enc, uint8_t id, tfx_program program, bool retain) {
 	tfx_view *view = &g_back.views[id];
+	enc->tmp_draw.program = program;
+	assert(program != 0);
 	assert(view != NULL);
 
-	tfx_draw_callback cb = g_tmp_draw.callback;
-	uint64_t flags = g_tmp_draw.flags;
-	reset();
-	g_tmp_draw.callback = cb;
-	if (g_tmp_draw.callback) {
-		g_tmp_draw.flags = flags;
+	tfx_draw add_state;
+	memcpy(&add_state, &enc->tmp_draw, sizeof(tfx_draw));
+	push_resources(enc, &add_state);
+	if (enc->bundle) {
+		// the view isn't known yet, keys are made when the bundle executes.
+		add_state.sort_key = 0;
+		sb_push(enc->draws[0], add_state);
 	}
-	sb_push(view->draws, g_tmp_draw);
-	g_tmp_draw.callback = NULL;
-	g_tmp_draw.flags = 0;
+	else {
+		add_state.sort_key = sort_key(view->flags & TFXI_VIEW_SORT_MASK, &enc->tmp_bindings, &add_state);
+		sb_push(enc->draws[id], add_state);
+	}
+
+	if (!retain) {
+		reset(enc);
+	}
+}
+
+void tfx_encoder_submit_ordered(tfx_encoder *enc, uint8_t id, tfx_program program, uint32_t depth, bool retain) {
+	enc->tmp_draw.depth = depth;
+	tfx_encoder_submit(enc, id, program, retain);
+}
+
+void tfx_encoder_submit_indirect(tfx_encoder *enc, uint8_t id, tfx_program program, tfx_buffer *args, uint32_t offset, uint32_t count) {
+	assert(g_caps.draw_indirect);
+	assert(args != NULL);
+	assert(count > 0);
+	// commands are read as uints.
+	assert((offset % 4) == 0);
+
+	// counts set with the vertices and indices are ignored, the commands have their own.
+	tfx_draw *draw = &enc->tmp_draw;
+	draw->indirect = args->gl_id;
+	draw->indirect_offset = args->offset + offset;
+	draw->indirect_count = count;
+	tfx_encoder_submit(enc, id, program, false);
+}
+
+void tfx_encoder_touch(tfx_encoder *enc, uint8_t id) {
+	tfx_draw *draw = &enc->tmp_draw;
+
+	tfx_draw_callback cb = draw->callback;
+	uint64_t flags = draw->flags;
+	reset(enc);
+	draw->callback = cb;
+	if (draw->callback) {
+		draw->flags = flags;
+	}
+	// touches don't carry any resources, not even uniforms.
+	draw->encoder = enc->bundle ? 0 : (uint8_t)(enc - g_back.encoders);
+	draw->uniforms = TFXI_NONE;
+	draw->bindings = TFXI_NONE;
+	draw->format = TFXI_NONE;
+	sb_push(enc->draws[enc->bundle ? 0 : id], *draw);
+	draw->callback = NULL;
+	draw->flags = 0;
+}
+
+void tfx_encoder_submit_bundle(tfx_encoder *enc, uint8_t id, tfx_bundle *bundle) {
+	assert(bundle != NULL);
+	assert(!bundle->encoder.active);
+	// bundles can't nest.
+	assert(!enc->bundle);
+
+	// the bundle's draws also get this encoder's current uniforms, before their own.
+	tfx_draw tmp;
+	memset(&tmp, 0, sizeof(tfx_draw));
+	push_uniforms(enc, &tmp);
+
+	tfx_bundle_ref ref;
+	ref.bundle = bundle;
+	ref.encoder = (uint8_t)(enc - g_back.encoders);
+	ref.uniforms = tmp.uniforms;
+	ref.uniform_count = tmp.uniform_count;
+	sb_push(enc->bundles[id], ref);
+}
+
+void tfx_set_uniform(tfx_uniform *uniform, const float *data, const int count) {
+	tfx_encoder_set_uniform(default_encoder(), uniform, data, count);
+}
+
+void tfx_set_uniform_int(tfx_uniform *uniform, const int *data, const int count) {
+	tfx_encoder_set_uniform_int(default_encoder(), uniform, data, count);
+}
+
+void tfx_set_callback(tfx_draw_callback cb) {
+	tfx_encoder_set_callback(default_encoder(), cb);
+}
+
+void tfx_set_scissor(uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
+	tfx_encoder_set_scissor(default_encoder(), x, y, w, h);
+}
+
+void tfx_set_texture(tfx_uniform *uniform, tfx_texture *tex, uint8_t slot) {
+	tfx_encoder_set_texture(default_encoder(), uniform, tex, slot);
+}
+
+void tfx_set_state(uint64_t flags) {
+	tfx_encoder_set_state(default_encoder(), flags);
+}
+
+void tfx_set_buffer(tfx_buffer *buf, uint8_t slot, bool write) {
+	tfx_encoder_set_buffer(default_encoder(), buf, slot, write);
+}
+
+void tfx_set_image(tfx_uniform *uniform, tfx_texture *tex, uint8_t slot, uint8_t mip, bool write) {
+	tfx_encoder_set_image(default_encoder(), uniform, tex, slot, mip, write);
+}
+
+void tfx_set_transient_buffer(tfx_transient_buffer tb) {
+	tfx_encoder_set_transient_buffer(default_encoder(), tb);
+}
+
+void tfx_set_transient_indices(tfx_transient_buffer tb) {
+	tfx_encoder_set_transient_indices(default_encoder(), tb);
+}
+
+void tfx_set_vertices(tfx_buffer *vbo, int count) {
+	tfx_encoder_set_vertices(default_encoder(), vbo, count);
+}
+
+void tfx_set_indices(tfx_buffer *ibo, int count, int offset) {
+	tfx_encoder_set_indices(default_encoder(), ibo, count, offset);
+}
+
+void tfx_set_instances(int count) {
+	tfx_encoder_set_instances(default_encoder(), count);
+}
+
+void tfx_set_instance_buffer(tfx_buffer *buf) {
+	tfx_encoder_set_instance_buffer(default_encoder(), buf);
+}
+
+void tfx_dispatch(uint8_t id, tfx_program program, uint32_t x, uint32_t y, uint32_t z) {
+	tfx_encoder_dispatch(default_encoder(), id, program, x, y, z);
+}
+
+void tfx_dispatch_indirect(uint8_t id, tfx_program program, tfx_buffer *args, uint32_t offset) {
+	tfx_encoder_dispatch_indirect(default_encoder(), id, program, args, offset);
+}
+
+void tfx_submit(uint8_t id, tfx_program program, bool retain) {
+	tfx_encoder_submit(default_encoder(), id, program, retain);
+}
+
+void tfx_submit_ordered(uint8_t id, tfx_program program, uint32_t depth, bool retain) {
+	tfx_encoder_submit_ordered(default_encoder(), id, program, depth, retain);
+}
+
+void tfx_submit_indirect(uint8_t id, tfx_program program, tfx_buffer *args, uint32_t offset, uint32_t count) {
+	tfx_encoder_submit_indirect(default_encoder(), id, program, args, offset, count);
+}
+
+void tfx_submit_bundle(uint8_t id, tfx_bundle *bundle) {
+	tfx_encoder_submit_bundle(default_encoder(), id, bundle);
+}
+
+void tfx_touch(uint8_t id) {
+	tfx_encoder_touch(default_encoder(), id);
 }
 
 void tfx_blit(uint8_t dst, uint8_t src, uint16_t x, uint16_t y, uint16_t w, uint16_t h, int mip) {
@@ -2678,7 +4322,7 @@ void tfx_blit(uint8_t dst, uint8_t src, uint16_t x, uint16_t y, uint16_t w, uint
 	rect.h = h;
 
 	tfx_blit_op blit;
-	blit.source = get_canvas(&g_back.views[src]);
+	blit.source_view = src;
 	blit.source_mip = mip;
 	blit.rect = rect;
 	blit.mask = 0;
@@ -2687,7 +4331,7 @@ void tfx_blit(uint8_t dst, uint8_t src, uint16_t x, uint16_t y, uint16_t w, uint
 	tfx_canvas *canvas = get_canvas(view);
 
 	// blit to self doesn't make sense, and msaa resolve is automatic.
-	assert(blit.source != canvas);
+	assert(get_canvas(&g_back.views[src]) != canvas);
 
 	for (unsigned i = 0; i < canvas->allocated; i++) {
 		tfx_texture *attach = &canvas->attachments[i];
@@ -2706,6 +4350,42 @@ void tfx_blit(uint8_t dst, uint8_t src, uint16_t x, uint16_t y, uint16_t w, uint
 	sb_push(view->blits, blit);
 }
 
+void tfx_buffer_copy(uint8_t id, tfx_buffer *dst, uint32_t dst_offset, tfx_buffer *src, uint32_t src_offset, uint32_t size) {
+	assert(dst != NULL && src != NULL);
+	assert(size > 0);
+	assert(dst_offset + size <= dst->size);
+	assert(src_offset + size <= src->size);
+	assert(tfx_glCopyBufferSubData);
+
+	tfx_copy_op copy;
+	copy.dst = dst->gl_id;
+	copy.src = src->gl_id;
+	copy.dst_offset = dst->offset + dst_offset;
+	copy.src_offset = src->offset + src_offset;
+	copy.size = size;
+	copy.value = 0;
+	// overlapping copies within a buffer are undefined.
+	assert(copy.dst != copy.src || copy.dst_offset + size <= copy.src_offset || copy.src_offset + size <= copy.dst_offset);
+	sb_push(g_back.views[id].copies, copy);
+}
+
+void tfx_buffer_clear(uint8_t id, tfx_buffer *buf, uint32_t offset, uint32_t size, uint32_t value) {
+	assert(buf != NULL);
+	assert(size > 0);
+	assert(offset + size <= buf->size);
+	// cleared as 32 bit values.
+	assert((offset % 4) == 0 && (size % 4) == 0);
+
+	tfx_copy_op clear;
+	clear.dst = buf->gl_id;
+	clear.src = 0;
+	clear.dst_offset = buf->offset + offset;
+	clear.src_offset = 0;
+	clear.size = size;
+	clear.value = value;
+	sb_push(g_back.views[id].copies, clear);
+}
+
 static void release_compiler() {
 	if (!g_shaderc_allocated) {
 		return;
@@ -2721,20 +4401,295 @@ static void release_compiler() {
 	g_shaderc_allocated = false;
 }
 
-static void update_uniforms(tfx_draw *draw) {
-	int nu = sb_count(draw->uniforms);
-	for (int j = 0; j < nu; j++) {
-		tfx_uniform uniform = draw->uniforms[j];
+// lsd radix sort, 8 bits per pass. it's stable, so draws with equal keys keep
+// their submission order. passes where every key has the same digit are
+// skipped, which is most of them for typical keys. returns whichever of the
+// two buffers holds the result.
+static tfx_sort_item *radix_sort(tfx_sort_item *items, tfx_sort_item *scratch, int n) {
+	uint32_t hist[8][256];
+	memset(hist, 0, sizeof(hist));
+	for (int i = 0; i < n; i++) {
+		uint64_t key = items[i].key;
+		for (int p = 0; p < 8; p++) {
+			hist[p][(key >> (p * 8)) & 0xff] += 1;
+		}
+	}
 
-		tfx_shadermap *val = tfx_proglookup(g_back.uniform_map, draw->program);
-		tfx_locmap **locmap = val->value;
-		tfx_locmap *locval = tfx_loclookup(locmap, uniform.name);
-#ifdef TFX_DEBUG
-		assert(locval);
-#endif
+	tfx_sort_item *src = items;
+	tfx_sort_item *dst = scratch;
+	for (int p = 0; p < 8; p++) {
+		uint32_t *h = hist[p];
+		int shift = p * 8;
+		if (h[(src[0].key >> shift) & 0xff] == (uint32_t)n) {
+			continue;
+		}
+		uint32_t sum = 0;
+		for (int i = 0; i < 256; i++) {
+			uint32_t count = h[i];
+			h[i] = sum;
+			sum += count;
+		}
+		for (int i = 0; i < n; i++) {
+			tfx_sort_item item = src[i];
+			dst[h[(item.key >> shift) & 0xff]++] = item;
+		}
+		tfx_sort_item *tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+	return src;
+}
+
+static void count_draws(tfx_frame_state *fs, int id, int *draws, int *jobs) {
+	*draws = 0;
+	*jobs = 0;
+	for (int e = 0; e < TFX_ENCODER_MAX+1; e++) {
+		tfx_encoder *enc = &fs->encoders[e];
+		*draws += sb_count(enc->draws[id]);
+		*jobs += sb_count(enc->jobs[id]);
+		int nb = sb_count(enc->bundles[id]);
+		for (int i = 0; i < nb; i++) {
+			tfx_encoder *be = &enc->bundles[id][i].bundle->encoder;
+			*draws += sb_count(be->draws[0]);
+			*jobs += sb_count(be->jobs[0]);
+		}
+	}
+}
+
+// bundles don't know which view they'll be in when recorded, so keys are
+// made on first use and kept until a view with another sort mode uses them.
+static uint64_t *bundle_keys(tfx_bundle *bundle, uint32_t mode) {
+	tfx_encoder *enc = &bundle->encoder;
+	int n = sb_count(enc->draws[0]);
+	if (bundle->keys && bundle->key_mode == mode) {
+		return bundle->keys;
+	}
+
+	sb_clear(bundle->keys);
+	uint64_t *keys = sb_add(bundle->keys, n);
+	tfx_bindings empty;
+	memset(&empty, 0, sizeof(tfx_bindings));
+	for (int i = 0; i < n; i++) {
+		tfx_draw *draw = &enc->draws[0][i];
+		tfx_bindings *bindings = draw->bindings != TFXI_NONE ? &enc->bindings[draw->bindings] : &empty;
+		keys[i] = sort_key(mode, bindings, draw);
+	}
+	bundle->key_mode = mode;
+	return keys;
+}
 
-		GLint loc = locval->value;
-		if (loc < 0) {
+// gather a view's draws (or compute jobs) from every encoder. the default
+// encoder goes first, then each slot in order, so the result doesn't depend on
+// which thread finished first. draws are then ordered by key if the view sorts.
+static tfx_sort_item *collect_draws(tfx_frame_state *fs, int id, int count, bool jobs) {
+	// keep these around between frames, so we aren't reallocating every view.
+	int have = sb_count(g_sort_items);
+	if (have < count) {
+		sb_add(g_sort_items, count - have);
+		sb_add(g_sort_scratch, count - have);
+	}
+
+	uint32_t mode = fs->views[id].flags & TFXI_VIEW_SORT_MASK;
+	bool sorted = !jobs && count > 1 && mode != 0 && mode != TFXI_VIEW_SORT_SEQUENTIAL;
+
+	int n = 0;
+	for (int e = 0; e < TFX_ENCODER_MAX+1; e++) {
+		tfx_encoder *enc = &fs->encoders[e];
+		tfx_draw *list = jobs ? enc->jobs[id] : enc->draws[id];
+		int nl = sb_count(list);
+		for (int i = 0; i < nl; i++, n++) {
+			g_sort_items[n].key = list[i].sort_key;
+			g_sort_items[n].draw = &list[i];
+			g_sort_items[n].ref = NULL;
+		}
+
+		// bundles submitted from this encoder follow its own draws.
+		int nb = sb_count(enc->bundles[id]);
+		for (int b = 0; b < nb; b++) {
+			tfx_bundle_ref *ref = &enc->bundles[id][b];
+			list = jobs ? ref->bundle->encoder.jobs[0] : ref->bundle->encoder.draws[0];
+			nl = sb_count(list);
+			uint64_t *keys = sorted ? bundle_keys(ref->bundle, mode) : NULL;
+			for (int i = 0; i < nl; i++, n++) {
+				g_sort_items[n].key = keys ? keys[i] : 0;
+				g_sort_items[n].draw = &list[i];
+				g_sort_items[n].ref = ref;
+			}
+		}
+	}
+	assert(n == count);
+
+	if (!sorted) {
+		return g_sort_items;
+	}
+
+	return radix_sort(g_sort_items, g_sort_scratch, count);
+}
+
+#define TFXI_LOCATION_UNKNOWN -2
+
+// find the uniform info for a program, making an empty one the first time
+// it's seen. GL hands out small names, so they index directly.
+static tfx_program_info *program_info(tfx_program program) {
+	int have = sb_count(g_program_info);
+	if ((int)program >= have) {
+		int count = (int)program + 1;
+		memset(sb_add(g_program_info, count - have), 0, sizeof(tfx_program_info) * (count - have));
+	}
+	return &g_program_info[program];
+}
+
+static void program_blocks(tfx_program_info *info, tfx_program program) {
+	info->blocks_queried = true;
+
+	GLint count = 0;
+	CHECK(tfx_glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count));
+	if (count > TFXI_UNIFORM_BLOCK_MAX) {
+		TFX_WARN("program has %d uniform blocks, only the first %d will be bound", count, TFXI_UNIFORM_BLOCK_MAX);
+		count = TFXI_UNIFORM_BLOCK_MAX;
+	}
+	for (GLint i = 0; i < count; i++) {
+		GLint size = 0;
+		CHECK(tfx_glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_DATA_SIZE, &size));
+		CHECK(tfx_glUniformBlockBinding(program, i, i));
+
+		tfx_uniform_block block;
+		memset(&block, 0, sizeof(tfx_uniform_block));
+		block.binding = i;
+		block.size = (uint32_t)size;
+		block.shadow = calloc(1, size > 0 ? size : 1);
+		block.dirty = true;
+		sb_push(info->blocks, block);
+	}
+}
+
+static tfx_uniform_slot *uniform_slot(tfx_program_info *info, tfx_program program, tfx_uniform *uniform) {
+	int have = sb_count(info->uniforms);
+	if ((int)uniform->id >= have) {
+		tfx_uniform_slot *added = sb_add(info->uniforms, uniform->id + 1 - have);
+		memset(added, 0, sizeof(tfx_uniform_slot) * (uniform->id + 1 - have));
+		for (int i = 0; i < (int)uniform->id + 1 - have; i++) {
+			added[i].location = TFXI_LOCATION_UNKNOWN;
+			added[i].block = -1;
+		}
+	}
+
+	tfx_uniform_slot *slot = &info->uniforms[uniform->id];
+	if (slot->location != TFXI_LOCATION_UNKNOWN) {
+		return slot;
+	}
+
+	// missing uniforms are cached too, so we only ask once.
+	slot->location = -1;
+	if (sb_count(info->blocks) > 0) {
+		GLuint index = GL_INVALID_INDEX;
+		const GLchar *name = uniform->name;
+		CHECK(tfx_glGetUniformIndices(program, 1, &name, &index));
+		if (index != GL_INVALID_INDEX) {
+			GLint block = -1;
+			CHECK(tfx_glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_BLOCK_INDEX, &block));
+			if (block >= 0 && block < sb_count(info->blocks)) {
+				slot->block = block;
+				CHECK(tfx_glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_OFFSET, &slot->offset));
+				CHECK(tfx_glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_ARRAY_STRIDE, &slot->array_stride));
+				CHECK(tfx_glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_MATRIX_STRIDE, &slot->matrix_stride));
+				return slot;
+			}
+		}
+	}
+	slot->location = CHECK(tfx_glGetUniformLocation(program, uniform->name));
+	return slot;
+}
+
+// programs keep their uniform values between uses, so anything matching the
+// last upload to this program can be skipped.
+static bool uniform_changed(tfx_uniform_slot *slot, tfx_uniform *uniform) {
+	uint32_t size = (uint32_t)(uniform->last_count * uniform_size_for(uniform->type));
+	if (slot->shadow && slot->count == uniform->last_count && slot->size == size && memcmp(slot->shadow, uniform->data, size) == 0) {
+		return false;
+	}
+
+	if (size > slot->capacity) {
+		slot->shadow = realloc(slot->shadow, size);
+		slot->capacity = size;
+	}
+	memcpy(slot->shadow, uniform->data, size);
+	slot->count = uniform->last_count;
+	slot->size = size;
+	return true;
+}
+
+// copy a uniform into its block using the layout GL reported, uniforms are tightly packed.
+static void pack_uniform(tfx_uniform_block *block, tfx_uniform_slot *slot, tfx_uniform *uniform) {
+	int columns = 1;
+	int rows = 1;
+	switch (uniform->type) {
+		case TFX_UNIFORM_VEC2: rows = 2; break;
+		case TFX_UNIFORM_VEC3: rows = 3; break;
+		case TFX_UNIFORM_VEC4: rows = 4; break;
+		case TFX_UNIFORM_MAT2: columns = rows = 2; break;
+		case TFX_UNIFORM_MAT3: columns = rows = 3; break;
+		case TFX_UNIFORM_MAT4: columns = rows = 4; break;
+		default: break;
+	}
+
+	uint32_t column_size = rows * sizeof(float);
+	const uint8_t *src = uniform->data;
+	for (int i = 0; i < uniform->last_count; i++) {
+		uint32_t base = slot->offset + i * slot->array_stride;
+		for (int c = 0; c < columns; c++) {
+			uint32_t dst = base + c * slot->matrix_stride;
+			if (dst + column_size > block->size) {
+				// more elements than the shader declared.
+				break;
+			}
+			memcpy(block->shadow + dst, src, column_size);
+			src += column_size;
+		}
+		if (slot->array_stride == 0) {
+			break;
+		}
+	}
+	block->dirty = true;
+}
+
+// copy changed blocks into the ring and bind them.
+static void update_blocks(tfx_program_info *info) {
+	int nb = sb_count(info->blocks);
+	for (int i = 0; i < nb; i++) {
+		tfx_uniform_block *block = &info->blocks[i];
+		if (block->size == 0) {
+			continue;
+		}
+		if (block->dirty || block->epoch != g_uniform_ring.epoch) {
+			block->offset = uniform_ring_alloc(block->size);
+			block->epoch = g_uniform_ring.epoch;
+			block->dirty = false;
+			memcpy(g_uniform_ring.ptr + block->offset, block->shadow, block->size);
+		}
+		if (g_uniform_ring.bound[block->binding] != block->offset) {
+			CHECK(tfx_glBindBufferRange(GL_UNIFORM_BUFFER, block->binding, g_uniform_ring.gl_id, block->offset, block->size));
+			g_uniform_ring.bound[block->binding] = block->offset;
+		}
+	}
+}
+
+static void apply_uniforms(tfx_program_info *info, tfx_program program, tfx_uniform *uniforms, int nu, tfx_stats *stats) {
+	for (int j = 0; j < nu; j++) {
+		tfx_uniform uniform = uniforms[j];
+
+		tfx_uniform_slot *slot = uniform_slot(info, program, &uniform);
+		GLint loc = slot->location;
+		if (loc < 0 && slot->block < 0) {
+			continue;
+		}
+		if (!uniform_changed(slot, &uniform)) {
+			stats->uniforms_skipped += 1;
+			continue;
+		}
+		stats->uniforms += 1;
+		if (slot->block >= 0) {
+			pack_uniform(&info->blocks[slot->block], slot, &uniform);
 			continue;
 		}
 		switch (uniform.type) {
@@ -2751,6 +4706,123 @@ static void update_uniforms(tfx_draw *draw) {
 	}
 }
 
+// the encoder holding a draw's side tables.
+static tfx_encoder *item_encoder(tfx_frame_state *fs, tfx_sort_item *item) {
+	if (item->ref) {
+		return &item->ref->bundle->encoder;
+	}
+	return &fs->encoders[item->draw->encoder];
+}
+
+// true if b can be drawn by the same multi-draw as a. nothing can change
+// between draws of a batch, so only the vertex and index ranges may differ.
+static bool draws_batchable(tfx_frame_state *fs, tfx_sort_item *a, tfx_sort_item *b) {
+	tfx_draw *da = a->draw;
+	tfx_draw *db = b->draw;
+	if (da->indirect || db->indirect) {
+		return false;
+	}
+	if (db->callback != NULL || da->program != db->program || da->flags != db->flags) {
+		return false;
+	}
+	if (da->use_vbo != db->use_vbo || da->use_ibo != db->use_ibo || da->use_tvb != db->use_tvb || da->use_tib != db->use_tib || da->index_32 != db->index_32) {
+		return false;
+	}
+	if ((da->use_tvb && da->tvb_chunk != db->tvb_chunk) || (da->use_tib && da->tib_chunk != db->tib_chunk)) {
+		return false;
+	}
+	if (da->use_scissor != db->use_scissor || (da->use_scissor && memcmp(&da->scissor_rect, &db->scissor_rect, sizeof(tfx_rect)) != 0)) {
+		return false;
+	}
+	if ((da->use_vbo && !da->use_tvb && da->vbo != db->vbo) || (da->use_ibo && da->ibo != db->ibo)) {
+		return false;
+	}
+	// instance counts go in the commands, but the stream has to match.
+	if (da->instance_vbo != db->instance_vbo) {
+		return false;
+	}
+
+	// uniform snapshots are shared until something changes, so equal ones have the same index.
+	tfx_encoder *enc = item_encoder(fs, a);
+	if (enc != item_encoder(fs, b) || a->ref != b->ref || da->uniforms != db->uniforms || da->uniform_count != db->uniform_count) {
+		return false;
+	}
+
+	if (da->bindings != db->bindings) {
+		if (da->bindings == TFXI_NONE || db->bindings == TFXI_NONE) {
+			return false;
+		}
+		if (memcmp(&enc->bindings[da->bindings], &enc->bindings[db->bindings], sizeof(tfx_bindings)) != 0) {
+			return false;
+		}
+	}
+	// shader writes need a barrier before the next draw reads them.
+	if (db->bindings != TFXI_NONE) {
+		tfx_bindings *bind = &enc->bindings[db->bindings];
+		if (bind->buffers_write != 0 || bind->textures_write != 0) {
+			return false;
+		}
+	}
+
+	if (da->use_vbo && da->format != db->format) {
+		if (memcmp(&enc->formats[da->format], &enc->formats[db->format], sizeof(tfx_vertex_format)) != 0) {
+			return false;
+		}
+	}
+	if (da->instance_vbo && da->instance_format != db->instance_format) {
+		if (memcmp(&enc->formats[da->instance_format], &enc->formats[db->instance_format], sizeof(tfx_vertex_format)) != 0) {
+			return false;
+		}
+	}
+
+	if (da->use_ibo) {
+		uint32_t index_size = da->index_32 ? 4 : 2;
+		if ((da->index_offset % index_size) != 0 || (db->index_offset % index_size) != 0) {
+			return false;
+		}
+	}
+	// transient vertices are drawn relative to where the first draw bound the buffer.
+	if (da->use_tvb) {
+		uint32_t stride = enc->formats[da->format].stride;
+		return db->offset >= da->offset && ((db->offset - da->offset) % stride) == 0;
+	}
+	return true;
+}
+
+static void update_uniforms(tfx_frame_state *fs, tfx_sort_item *item, tfx_stats *stats) {
+	tfx_draw *draw = item->draw;
+	tfx_bundle_ref *ref = item->ref;
+	int nu = draw->uniform_count;
+	int nr = ref ? ref->uniform_count : 0;
+	// blocks still need binding without any new uniforms, another program may have used the binding points.
+	if (draw->program == 0 || (nu == 0 && nr == 0 && !g_uniform_ring.ptr)) {
+		return;
+	}
+
+	tfx_program_info *info = program_info(draw->program);
+	if (!info) {
+		return;
+	}
+
+	if (g_uniform_ring.ptr && !info->blocks_queried) {
+		program_blocks(info, draw->program);
+	}
+
+	// uniforms from where the bundle was submitted go first, so the bundle's own win.
+	if (nr > 0) {
+		tfx_encoder *enc = &fs->encoders[ref->encoder];
+		apply_uniforms(info, draw->program, &enc->uniform_blocks[ref->uniforms], nr, stats);
+	}
+	if (nu > 0) {
+		tfx_encoder *enc = item_encoder(fs, item);
+		apply_uniforms(info, draw->program, &enc->uniform_blocks[draw->uniforms], nu, stats);
+	}
+
+	if (sb_count(info->blocks) > 0) {
+		update_blocks(info);
+	}
+}
+
 // 8x8 font based on the ibm (?) vga bios font, based on the haxe vga text renderer example.
 // TODO: change this to an 8x16 or so font, it'll look much better.
 static const char vga_font[] = {
@@ -2997,79 +5069,727 @@ void tfx_debug_blit_rgba(const int x, const int y, const int w, const int h, con
 	}
 }
 
-void tfx_debug_blit_pal(const int x, const int y, const int w, const int h, const uint8_t *pixels) {
-	assert(did_you_call_tfx_reset);
-
-	if ((g_flags & TFX_RESET_DEBUG_OVERLAY) != TFX_RESET_DEBUG_OVERLAY) {
+void tfx_debug_blit_pal(const int x, const int y, const int w, const int h, const uint8_t *pixels) {
+	assert(did_you_call_tfx_reset);
+
+	if ((g_flags & TFX_RESET_DEBUG_OVERLAY) != TFX_RESET_DEBUG_OVERLAY) {
+		return;
+	}
+
+	const unsigned bufw = g_debug_overlay.width;
+	const unsigned bufh = g_debug_overlay.height;
+	for (unsigned _y = 0; _y < (unsigned)h; _y++) {
+		unsigned row_base = (y + _y) * bufw;
+		unsigned row_local = _y * w;
+		for (unsigned _x = 0; _x < (unsigned)w; _x++) {
+			uint8_t idx = pixels[row_local + _x];
+			g_debug_data[row_base + _x + x] = g_debug_palette[idx];
+		}
+	}
+}
+
+void tfx_debug_print(const int baserow, const int basecol, const uint16_t bg_fg, const int auto_wrap, const char *str) {
+	assert(did_you_call_tfx_reset);
+
+	if ((g_flags & TFX_RESET_DEBUG_OVERLAY) != TFX_RESET_DEBUG_OVERLAY) {
+		return;
+	}
+
+	const char *head = str;
+	const int bufw = g_debug_overlay.width;
+	const int bufh = g_debug_overlay.height;
+	int row = baserow;
+	int col = basecol;
+	const size_t bg_idx = bg_fg >> 8;
+	const size_t fg_idx = bg_fg & 0xff;
+	const uint32_t bg = g_debug_palette[bg_idx];
+	const uint32_t fg = g_debug_palette[fg_idx];
+	while (*head) {
+		char c = *head;
+		if (auto_wrap) {
+			int skip = c == ' ' && col == 0;
+			if (skip) {
+				head++;
+				continue;
+			}
+		}
+		int newline = c == '\n' || c == '\r';
+		int x = (col << 3); // + (col>>1)
+		int wrap = x + 8 >= bufw;
+		if (!auto_wrap && wrap) {
+			head++;
+			continue;
+		}
+		wrap |= newline;
+		if (wrap) {
+			col = basecol;
+			row += 1;
+			if (newline) {
+				head++;
+			}
+			continue;
+		}
+		int y = (row << 3); // + (row >> 1)
+		if (y + 8 >= bufh) {
+			break;
+		}
+		render_letter(bufw, *head, y, x, fg, bg, g_debug_data);
+		col++;
+		head++;
+	}
+}
+
+// barriers owed for shader writes, issued just before anything reads.
+static GLbitfield g_pending_barriers = 0;
+
+static void memory_barrier(GLbitfield bits) {
+	bits &= g_pending_barriers;
+	if (bits != 0 && tfx_glMemoryBarrier) {
+		CHECK(tfx_glMemoryBarrier(bits));
+	}
+	g_pending_barriers &= ~bits;
+}
+
+// shadow of the GL state frames touch, so redundant calls can be skipped.
+// it's only trusted within a frame, anything outside of tfx (or a draw
+// callback) may change state behind our back.
+static struct {
+	GLuint program;
+	GLuint vao;
+	GLuint array_buffer;
+	GLuint draw_fbo;
+	GLuint read_fbo;
+	GLenum active_texture;
+	GLenum texture_targets[8];
+	GLuint textures[8];
+	GLuint storage_buffers[8];
+	uint32_t storage_offsets[8];
+	uint32_t storage_sizes[8];
+	GLuint indirect_buffer;
+	GLuint dispatch_buffer;
+	GLuint copy_read_buffer;
+	GLuint copy_write_buffer;
+
+	// enables are 0/1, anything else means unknown.
+	uint8_t depth_test;
+	uint8_t blend;
+	uint8_t cull;
+	uint8_t scissor_test;
+	uint8_t multisample;
+	uint8_t depth_mask;
+	uint8_t color_mask[4];
+
+	GLenum depth_func;
+	GLenum front_face;
+	GLenum blend_src;
+	GLenum blend_dst;
+	GLenum polygon_mode;
+	GLint viewport[4];
+	GLint scissor[4];
+	float clear_color[4];
+	float clear_depth;
+
+	uint32_t calls;
+	uint32_t skipped;
+} g_state;
+
+static void state_invalidate() {
+	uint32_t calls = g_state.calls;
+	uint32_t skipped = g_state.skipped;
+	// all ones is never a valid value, and NaN for the floats never compares equal.
+	memset(&g_state, 0xff, sizeof(g_state));
+	g_state.calls = calls;
+	g_state.skipped = skipped;
+}
+
+// true if the call needs making, counting it either way.
+static bool state_changed(bool changed) {
+	if (changed) {
+		g_state.calls += 1;
+	}
+	else {
+		g_state.skipped += 1;
+	}
+	return changed;
+}
+
+static void state_program(GLuint program) {
+	if (state_changed(g_state.program != program)) {
+		CHECK(tfx_glUseProgram(program));
+		g_state.program = program;
+	}
+}
+
+static void state_vao(GLuint vao) {
+	if (state_changed(g_state.vao != vao)) {
+		CHECK(tfx_glBindVertexArray(vao));
+		g_state.vao = vao;
+	}
+}
+
+static void state_array_buffer(GLuint buffer) {
+	if (state_changed(g_state.array_buffer != buffer)) {
+		CHECK(tfx_glBindBuffer(GL_ARRAY_BUFFER, buffer));
+		g_state.array_buffer = buffer;
+	}
+}
+
+// GL_FRAMEBUFFER sets both targets.
+static void state_framebuffer(GLenum target, GLuint fbo) {
+	bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+	bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+	if (state_changed((draw && g_state.draw_fbo != fbo) || (read && g_state.read_fbo != fbo))) {
+		CHECK(tfx_glBindFramebuffer(target, fbo));
+		if (draw) {
+			g_state.draw_fbo = fbo;
+		}
+		if (read) {
+			g_state.read_fbo = fbo;
+		}
+	}
+}
+
+static void state_texture(int unit, GLenum target, GLuint texture) {
+	assert(unit >= 0 && unit < 8);
+	if (!state_changed(g_state.textures[unit] != texture || g_state.texture_targets[unit] != target)) {
+		return;
+	}
+	if (state_changed(g_state.active_texture != (GLenum)unit)) {
+		CHECK(tfx_glActiveTexture(GL_TEXTURE0 + unit));
+		g_state.active_texture = unit;
+	}
+	CHECK(tfx_glBindTexture(target, texture));
+	g_state.textures[unit] = texture;
+	g_state.texture_targets[unit] = target;
+}
+
+// multibind version, only the span of units which changed is rebound.
+// zeroes unbind, like glBindTextures.
+static void state_textures(GLuint *textures, GLenum *targets) {
+	int first = -1;
+	int last = -1;
+	for (int i = 0; i < 8; i++) {
+		if (g_state.textures[i] != textures[i] || (textures[i] != 0 && g_state.texture_targets[i] != targets[i])) {
+			if (first < 0) {
+				first = i;
+			}
+			last = i;
+		}
+	}
+	if (!state_changed(first >= 0)) {
+		return;
+	}
+	CHECK(tfx_glBindTextures(first, last - first + 1, &textures[first]));
+	for (int i = first; i <= last; i++) {
+		g_state.textures[i] = textures[i];
+		g_state.texture_targets[i] = targets[i];
+	}
+}
+
+// a zero size binds the whole buffer.
+static void state_storage_buffer(int slot, GLuint buffer, uint32_t offset, uint32_t size) {
+	assert(slot >= 0 && slot < 8);
+	bool changed = g_state.storage_buffers[slot] != buffer || g_state.storage_offsets[slot] != offset || g_state.storage_sizes[slot] != size;
+	if (state_changed(changed)) {
+		if (size > 0) {
+			CHECK(tfx_glBindBufferRange(GL_SHADER_STORAGE_BUFFER, slot, buffer, offset, size));
+		}
+		else {
+			CHECK(tfx_glBindBufferBase(GL_SHADER_STORAGE_BUFFER, slot, buffer));
+		}
+		g_state.storage_buffers[slot] = buffer;
+		g_state.storage_offsets[slot] = offset;
+		g_state.storage_sizes[slot] = size;
+	}
+}
+
+// for binding points only used to name a buffer to a call.
+static void state_buffer(GLenum target, GLuint *current, GLuint buffer) {
+	if (state_changed(*current != buffer)) {
+		CHECK(tfx_glBindBuffer(target, buffer));
+		*current = buffer;
+	}
+}
+
+static void state_indirect_buffer(GLuint buffer) {
+	state_buffer(GL_DRAW_INDIRECT_BUFFER, &g_state.indirect_buffer, buffer);
+}
+
+static void state_enable(GLenum cap, uint8_t *current, bool enable) {
+	if (state_changed(*current != (uint8_t)enable)) {
+		if (enable) {
+			CHECK(tfx_glEnable(cap));
+		}
+		else {
+			CHECK(tfx_glDisable(cap));
+		}
+		*current = enable;
+	}
+}
+
+static void state_depth_func(GLenum func) {
+	if (state_changed(g_state.depth_func != func)) {
+		CHECK(tfx_glDepthFunc(func));
+		g_state.depth_func = func;
+	}
+}
+
+static void state_depth_mask(bool write) {
+	if (state_changed(g_state.depth_mask != (uint8_t)write)) {
+		CHECK(tfx_glDepthMask(write));
+		g_state.depth_mask = write;
+	}
+}
+
+static void state_color_mask(bool r, bool g, bool b, bool a) {
+	uint8_t mask[4] = { r, g, b, a };
+	if (state_changed(memcmp(g_state.color_mask, mask, 4) != 0)) {
+		CHECK(tfx_glColorMask(r, g, b, a));
+		memcpy(g_state.color_mask, mask, 4);
+	}
+}
+
+static void state_front_face(GLenum mode) {
+	if (state_changed(g_state.front_face != mode)) {
+		CHECK(tfx_glFrontFace(mode));
+		g_state.front_face = mode;
+	}
+}
+
+static void state_blend_func(GLenum src, GLenum dst) {
+	if (state_changed(g_state.blend_src != src || g_state.blend_dst != dst)) {
+		CHECK(tfx_glBlendFunc(src, dst));
+		g_state.blend_src = src;
+		g_state.blend_dst = dst;
+	}
+}
+
+static void state_polygon_mode(GLenum mode) {
+	if (state_changed(g_state.polygon_mode != mode)) {
+		CHECK(tfx_glPolygonMode(GL_FRONT_AND_BACK, mode));
+		g_state.polygon_mode = mode;
+	}
+}
+
+static void state_viewport(GLint x, GLint y, GLint w, GLint h) {
+	GLint vp[4] = { x, y, w, h };
+	if (state_changed(memcmp(g_state.viewport, vp, sizeof(vp)) != 0)) {
+		CHECK(tfx_glViewport(x, y, w, h));
+		memcpy(g_state.viewport, vp, sizeof(vp));
+	}
+}
+
+static void state_scissor(GLint x, GLint y, GLint w, GLint h) {
+	GLint rect[4] = { x, y, w, h };
+	if (state_changed(memcmp(g_state.scissor, rect, sizeof(rect)) != 0)) {
+		CHECK(tfx_glScissor(x, y, w, h));
+		memcpy(g_state.scissor, rect, sizeof(rect));
+	}
+}
+
+static void state_clear_color(float r, float g, float b, float a) {
+	float *c = g_state.clear_color;
+	if (state_changed(c[0] != r || c[1] != g || c[2] != b || c[3] != a)) {
+		CHECK(tfx_glClearColor(r, g, b, a));
+		c[0] = r;
+		c[1] = g;
+		c[2] = b;
+		c[3] = a;
+	}
+}
+
+static void state_clear_depth(float depth) {
+	if (state_changed(g_state.clear_depth != depth)) {
+		CHECK(tfx_glClearDepthf(depth));
+		g_state.clear_depth = depth;
+	}
+}
+
+// upload the pending commands after the ones already written this frame,
+// returning where they went. the buffer is orphaned whenever it starts over,
+// so the GPU can keep reading the old storage.
+static uintptr_t indirect_upload() {
+	uint32_t size = sb_count(g_indirect.cmds) * sizeof(tfx_indirect_cmd);
+	if (!g_indirect.gl_id) {
+		CHECK(tfx_glGenBuffers(1, &g_indirect.gl_id));
+	}
+	state_indirect_buffer(g_indirect.gl_id);
+	if (g_indirect.offset == 0 || g_indirect.offset + size > g_indirect.size) {
+		// grow to fit everything written so far, so it only starts over once next frame.
+		uint32_t need = g_indirect.offset + size;
+		if (g_indirect.size == 0) {
+			g_indirect.size = 64 * 1024;
+		}
+		while (g_indirect.size < need) {
+			g_indirect.size *= 2;
+		}
+		g_indirect.offset = 0;
+		CHECK(tfx_glBufferData(GL_DRAW_INDIRECT_BUFFER, g_indirect.size, NULL, GL_STREAM_DRAW));
+	}
+	uintptr_t at = g_indirect.offset;
+	CHECK(tfx_glBufferSubData(GL_DRAW_INDIRECT_BUFFER, at, size, g_indirect.cmds));
+	g_indirect.offset += size;
+	return at;
+}
+
+// draw with arguments from the draw's indirect buffer, which must be bound.
+// commands are tightly packed, one call covers them all when multi-draw is available.
+static void issue_indirect(tfx_draw *draw, GLenum mode, tfx_stats *stats) {
+	GLenum index_mode = draw->index_32 ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+	uintptr_t at = draw->indirect_offset;
+	if (draw->indirect_count > 1 && g_caps.multi_draw_indirect && tfx_glMultiDrawElementsIndirect && tfx_glMultiDrawArraysIndirect) {
+		stats->draw_calls += 1;
+		if (draw->use_ibo) {
+			CHECK(tfx_glMultiDrawElementsIndirect(mode, index_mode, (const void*)at, draw->indirect_count, 0));
+		}
+		else {
+			CHECK(tfx_glMultiDrawArraysIndirect(mode, (const void*)at, draw->indirect_count, 0));
+		}
+		return;
+	}
+	for (uint32_t i = 0; i < draw->indirect_count; i++) {
+		stats->draw_calls += 1;
+		if (draw->use_ibo) {
+			CHECK(tfx_glDrawElementsIndirect(mode, index_mode, (const void*)at));
+			at += 5 * sizeof(uint32_t);
+		}
+		else {
+			CHECK(tfx_glDrawArraysIndirect(mode, (const void*)at));
+			at += 4 * sizeof(uint32_t);
+		}
+	}
+}
+
+static GLenum attrib_type(tfx_component_type type) {
+	switch (type) {
+		case TFX_TYPE_UBYTE:  return GL_UNSIGNED_BYTE;
+		case TFX_TYPE_BYTE:   return GL_BYTE;
+		case TFX_TYPE_USHORT: return GL_UNSIGNED_SHORT;
+		case TFX_TYPE_SHORT:  return GL_SHORT;
+		case TFX_TYPE_FLOAT:  return GL_FLOAT;
+		default: assert(0); return GL_FLOAT;
+	}
+}
+
+// point attributes of the bound vertex array at the bound vertex buffer,
+// starting from location first. returns the location after the last one.
+// with format_only, buffers are left alone and attributes read from binding.
+// otherwise divisors are set per attribute, divided tracks which have one.
+static int setup_attribs(tfx_vertex_format *fmt, int first, uint32_t va_offset, GLuint divisor, bool format_only, GLuint binding, uint16_t *divided) {
+	int nc = fmt->count;
+#ifdef TFX_DEBUG
+	assert(nc <= 8); // the mask is only 8 bits
+#endif
+
+	int real = first;
+	for (int i = 0; i < nc; i++) {
+		if ((fmt->component_mask & (1 << i)) == 0) {
+			continue;
+		}
+		tfx_vertex_component vc = fmt->components[i];
+		if (vc.type == TFX_TYPE_SKIP) {
+			continue;
+		}
+		GLenum gl_type = attrib_type(vc.type);
+		if (format_only) {
+			CHECK(tfx_glVertexAttribFormat(real, (GLint)vc.size, gl_type, vc.normalized, (GLuint)vc.offset));
+			CHECK(tfx_glVertexAttribBinding(real, binding));
+		}
+		else {
+			CHECK(tfx_glVertexAttribPointer(real, (GLint)vc.size, gl_type, vc.normalized, (GLsizei)fmt->stride, (GLvoid*)(uintptr_t)(vc.offset + va_offset)));
+			uint16_t bit = 1 << real;
+			if (divisor != 0 || (*divided & bit) != 0) {
+				CHECK(tfx_glVertexAttribDivisor(real, divisor));
+				*divided = divisor != 0 ? (*divided | bit) : (*divided & ~bit);
+			}
+		}
+		real += 1;
+	}
+	return real;
+}
+
+// enable the first count attributes of the bound vertex array and disable the
+// rest. enabled is how many it had enabled, and is updated.
+static void enable_attribs(int count, int *enabled) {
+	for (int i = *enabled; i < count; i++) {
+		CHECK(tfx_glEnableVertexAttribArray(i));
+	}
+	for (int i = count; i < *enabled; i++) {
+		CHECK(tfx_glDisableVertexAttribArray(i));
+	}
+	*enabled = count;
+}
+
+// find or make the vertex array for a mesh, and its instance buffer if there is one.
+static GLuint find_vao(GLuint vbo, GLuint ibo, tfx_vertex_format *fmt, GLuint instance_vbo, tfx_vertex_format *instance_fmt) {
+	tfx_vao **bucket = &g_vaos[vao_bucket(vbo, ibo, instance_vbo)];
+	int n = sb_count(*bucket);
+	for (int i = 0; i < n; i++) {
+		tfx_vao *vao = &(*bucket)[i];
+		if (vao->vbo != vbo || vao->ibo != ibo || vao->instance_vbo != instance_vbo) {
+			continue;
+		}
+		if (memcmp(&vao->format, fmt, sizeof(tfx_vertex_format)) != 0) {
+			continue;
+		}
+		if (instance_vbo && memcmp(&vao->instance_format, instance_fmt, sizeof(tfx_vertex_format)) != 0) {
+			continue;
+		}
+		return vao->gl_id;
+	}
+
+	tfx_vao vao;
+	memset(&vao, 0, sizeof(tfx_vao));
+	vao.vbo = vbo;
+	vao.ibo = ibo;
+	vao.instance_vbo = instance_vbo;
+	vao.format = *fmt;
+	CHECK(tfx_glGenVertexArrays(1, &vao.gl_id));
+	state_vao(vao.gl_id);
+	state_array_buffer(vbo);
+	uint16_t divided = 0;
+	int count = setup_attribs(fmt, 0, 0, 0, false, 0, &divided);
+	if (instance_vbo) {
+		vao.instance_format = *instance_fmt;
+		state_array_buffer(instance_vbo);
+		GLuint divisor = instance_fmt->divisor ? instance_fmt->divisor : 1;
+		count = setup_attribs(instance_fmt, count, 0, divisor, false, 0, &divided);
+	}
+	int enabled = 0;
+	enable_attribs(count, &enabled);
+	if (ibo) {
+		CHECK(tfx_glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo));
+	}
+	sb_push(*bucket, vao);
+	return vao.gl_id;
+}
+
+static tfx_texture *find_texture(uint32_t id) {
+	int slot = slot_find(&g_texture_slots, id);
+	return slot >= 0 ? &g_textures[slot] : NULL;
+}
+
+// copy a frame's transient data into the bound buffer.
+static void tvb_upload(GLenum target, const void *data, uint32_t used, uint32_t size) {
+	if (tfx_glMapBufferRange && tfx_glUnmapBuffer) {
+		// this is backed by multiple buffers, so invalidate might be pointless. need to profile.
+		void *ptr = tfx_glMapBufferRange(target, 0, used, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+		if (ptr) {
+			memcpy(ptr, data, used);
+			CHECK(tfx_glUnmapBuffer(target));
+		}
+	}
+	else {
+		// orphan the buffer explicitly if mapping isn't available
+		CHECK(tfx_glBufferData(target, size, NULL, GL_DYNAMIC_DRAW));
+		CHECK(tfx_glBufferSubData(target, 0, used, data));
+	}
+}
+
+static int update_cmp_range(const void *a, const void *b) {
+	const tfx_buffer_update_op *ua = (const tfx_buffer_update_op*)a;
+	const tfx_buffer_update_op *ub = (const tfx_buffer_update_op*)b;
+	if (ua->gl_id != ub->gl_id) {
+		return ua->gl_id < ub->gl_id ? -1 : 1;
+	}
+	if (ua->offset != ub->offset) {
+		return ua->offset < ub->offset ? -1 : 1;
+	}
+	return ua->seq < ub->seq ? -1 : (ua->seq > ub->seq);
+}
+
+static int update_cmp_seq(const void *a, const void *b) {
+	const tfx_buffer_update_op *ua = (const tfx_buffer_update_op*)a;
+	const tfx_buffer_update_op *ub = (const tfx_buffer_update_op*)b;
+	return ua->seq < ub->seq ? -1 : (ua->seq > ub->seq);
+}
+
+// queued buffer updates that touch or overlap are merged into one span, which
+// is mapped once and filled in the order the updates were made.
+static void apply_buffer_updates(tfx_frame_state *fs) {
+	// drop updates to buffers freed since they were queued, the GL name may
+	// already belong to another buffer.
+	int nbu = sb_count(fs->buffer_updates);
+	tfx_buffer_update_op *updates = fs->buffer_updates;
+	int keep = 0;
+	for (int i = 0; i < nbu; i++) {
+		if (slot_find(&g_buffer_slots, updates[i].id) >= 0) {
+			updates[keep++] = updates[i];
+		}
+	}
+	nbu = keep;
+	if (nbu > 1) {
+		qsort(updates, nbu, sizeof(tfx_buffer_update_op), update_cmp_range);
+	}
+	bool can_map = tfx_glMapBufferRange && tfx_glUnmapBuffer;
+	for (int i = 0; i < nbu;) {
+		uint32_t start = updates[i].offset;
+		uint32_t end = start + updates[i].size;
+		int last = i + 1;
+		while (last < nbu && updates[last].gl_id == updates[i].gl_id && updates[last].offset <= end) {
+			uint32_t update_end = updates[last].offset + updates[last].size;
+			if (update_end > end) {
+				end = update_end;
+			}
+			last++;
+		}
+		if (last - i > 1) {
+			qsort(&updates[i], last - i, sizeof(tfx_buffer_update_op), update_cmp_seq);
+		}
+
+		state_array_buffer(updates[i].gl_id);
+		// every byte of the span gets written, so the old contents can go.
+		uint8_t *ptr = NULL;
+		if (can_map) {
+			ptr = (uint8_t*)tfx_glMapBufferRange(GL_ARRAY_BUFFER, start, end - start, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+		}
+		for (int j = i; j < last; j++) {
+			tfx_buffer_update_op *update = &updates[j];
+			const uint8_t *data = fs->update_data + update->data;
+			if (ptr) {
+				memcpy(ptr + (update->offset - start), data, update->size);
+			}
+			else {
+				CHECK(tfx_glBufferSubData(GL_ARRAY_BUFFER, update->offset, update->size, data));
+			}
+		}
+		if (ptr) {
+			CHECK(tfx_glUnmapBuffer(GL_ARRAY_BUFFER));
+		}
+		i = last;
+	}
+	sb_clear(fs->buffer_updates);
+	sb_clear(fs->update_data);
+}
+
+static void issue_upload(tfx_upload *upload) {
+	if (upload->texture) {
+		int slot = slot_find(&g_texture_slots, upload->id);
+		if (slot < 0) {
+			return;
+		}
+		tfx_texture *tex = &g_textures[slot];
+		tfx_texture_params *internal = tex->internal;
+		uint16_t w = tex->width >> upload->mip;
+		uint16_t h = tex->height >> upload->mip;
+		state_texture(0, GL_TEXTURE_2D, tex->gl_ids[0]);
+		CHECK(tfx_glTexSubImage2D(GL_TEXTURE_2D, upload->mip, 0, 0, w ? w : 1, h ? h : 1, internal->format, internal->type, upload->data));
+		return;
+	}
+	int slot = slot_find(&g_buffer_slots, upload->id);
+	if (slot < 0) {
 		return;
 	}
+	state_array_buffer(g_buffers[slot].gl_id);
+	CHECK(tfx_glBufferSubData(GL_ARRAY_BUFFER, upload->offset, upload->size, upload->data));
+}
 
-	const unsigned bufw = g_debug_overlay.width;
-	const unsigned bufh = g_debug_overlay.height;
-	for (unsigned _y = 0; _y < (unsigned)h; _y++) {
-		unsigned row_base = (y + _y) * bufw;
-		unsigned row_local = _y * w;
-		for (unsigned _x = 0; _x < (unsigned)w; _x++) {
-			uint8_t idx = pixels[row_local + _x];
-			g_debug_data[row_base + _x + x] = g_debug_palette[idx];
+// copies and clears happen on the GPU, but shader writes still need a barrier
+// before they're read. anything after is ordered by GL already.
+static void issue_copies(tfx_copy_op *copies, int nc) {
+	memory_barrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	for (int i = 0; i < nc; i++) {
+		tfx_copy_op *op = &copies[i];
+		if (op->src) {
+			state_buffer(GL_COPY_READ_BUFFER, &g_state.copy_read_buffer, op->src);
+			state_buffer(GL_COPY_WRITE_BUFFER, &g_state.copy_write_buffer, op->dst);
+			CHECK(tfx_glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, op->src_offset, op->dst_offset, op->size));
+			continue;
+		}
+		state_buffer(GL_COPY_WRITE_BUFFER, &g_state.copy_write_buffer, op->dst);
+		if (tfx_glClearBufferSubData) {
+			CHECK(tfx_glClearBufferSubData(GL_COPY_WRITE_BUFFER, GL_R32UI, op->dst_offset, op->size, GL_RED_INTEGER, GL_UNSIGNED_INT, &op->value));
+		}
+		else {
+			// ES doesn't have clears, fill from the CPU instead.
+			int count = (int)(op->size / 4);
+			int have = sb_count(g_clear_fill);
+			if (have < count) {
+				sb_add(g_clear_fill, count - have);
+			}
+			for (int j = 0; j < count; j++) {
+				g_clear_fill[j] = op->value;
+			}
+			CHECK(tfx_glBufferSubData(GL_COPY_WRITE_BUFFER, op->dst_offset, op->size, g_clear_fill));
 		}
 	}
 }
 
-void tfx_debug_print(const int baserow, const int basecol, const uint16_t bg_fg, const int auto_wrap, const char *str) {
-	assert(did_you_call_tfx_reset);
+// issue queued uploads in order until this frame's budget is spent. at least
+// one always goes, so uploads bigger than the budget can't stall the queue.
+static void issue_uploads(tfx_stats *stats) {
+	uint64_t start = tfx_usec();
+	uint32_t bytes = 0;
+	uint32_t completed = 0;
+	while (true) {
+		tfx_sem_wait(&g_uploads.lock);
+		int nu = sb_count(g_uploads.queue);
+		bool over = stats->uploads > 0 && (
+			(g_uploads.budget_bytes && bytes >= g_uploads.budget_bytes) ||
+			(g_uploads.budget_usec && tfx_usec() - start >= g_uploads.budget_usec)
+		);
+		if (g_uploads.head == (uint32_t)nu || over) {
+			stats->uploads_pending = nu - g_uploads.head;
+			if (g_uploads.head == (uint32_t)nu) {
+				sb_clear(g_uploads.queue);
+				g_uploads.head = 0;
+			}
+			// uploads may keep coming faster than the budget allows, so move
+			// what's left to the front once most of the queue is consumed.
+			else if (g_uploads.head >= 64 && g_uploads.head * 2 >= (uint32_t)nu) {
+				uint32_t left = nu - g_uploads.head;
+				memmove(g_uploads.queue, &g_uploads.queue[g_uploads.head], left * sizeof(tfx_upload));
+				stb__sbn(g_uploads.queue) = left;
+				g_uploads.head = 0;
+			}
+			tfx_sem_post(&g_uploads.lock);
+			break;
+		}
+		tfx_upload upload = g_uploads.queue[g_uploads.head++];
+		tfx_sem_post(&g_uploads.lock);
 
-	if ((g_flags & TFX_RESET_DEBUG_OVERLAY) != TFX_RESET_DEBUG_OVERLAY) {
-		return;
+		issue_upload(&upload);
+		free(upload.data);
+		bytes += upload.size;
+		completed = upload.ticket;
+		stats->uploads += 1;
+		stats->upload_bytes += upload.size;
+	}
+	if (completed) {
+		tfx_atomic_store(&g_uploads.completed, completed);
 	}
+}
 
-	const char *head = str;
-	const int bufw = g_debug_overlay.width;
-	const int bufh = g_debug_overlay.height;
-	int row = baserow;
-	int col = basecol;
-	const size_t bg_idx = bg_fg >> 8;
-	const size_t fg_idx = bg_fg & 0xff;
-	const uint32_t bg = g_debug_palette[bg_idx];
-	const uint32_t fg = g_debug_palette[fg_idx];
-	while (*head) {
-		char c = *head;
-		if (auto_wrap) {
-			int skip = c == ' ' && col == 0;
-			if (skip) {
-				head++;
-				continue;
-			}
+// upload the used chunks of a frame's transient data, creating buffers for any chained on.
+static void tvb_upload_chunks(GLenum target, tfx_transient_data *td, tfx_buffer *buffers) {
+	for (uint32_t i = 0; i < TFX_TRANSIENT_CHUNK_MAX && i * td->size < td->offset; i++) {
+		uint32_t used = td->offset - i * td->size;
+		if (used > td->size) {
+			used = td->size;
 		}
-		int newline = c == '\n' || c == '\r';
-		int x = (col << 3); // + (col>>1)
-		int wrap = x + 8 >= bufw;
-		if (!auto_wrap && wrap) {
-			head++;
+		// coherent mappings were written in place, only staging copies need uploading.
+		if (i == 0 && g_transient_buffer.persistent) {
 			continue;
 		}
-		wrap |= newline;
-		if (wrap) {
-			col = basecol;
-			row += 1;
-			if (newline) {
-				head++;
-			}
-			continue;
+		if (!buffers[i].gl_id) {
+			uint8_t *mapped;
+			buffers[i].gl_id = tvb_create(target, td->size, false, &mapped);
 		}
-		int y = (row << 3); // + (row >> 1)
-		if (y + 8 >= bufh) {
-			break;
+		if (target == GL_ARRAY_BUFFER) {
+			state_array_buffer(buffers[i].gl_id);
 		}
-		render_letter(bufw, *head, y, x, fg, bg, g_debug_data);
-		col++;
-		head++;
+		else {
+			// the scratch vertex array is bound, if there is one.
+			CHECK(tfx_glBindBuffer(target, buffers[i].gl_id));
+			g_scratch_ibo = buffers[i].gl_id;
+		}
+		tvb_upload(target, td->chunks[i], used, td->size);
 	}
 }
 
-tfx_stats tfx_frame() {
-	assert(did_you_call_tfx_reset);
-
+// executes a recorded frame. this is the only place GL sees draws, so with a
+// render thread it runs there, otherwise it runs straight from tfx_frame.
+static tfx_stats render_frame(tfx_frame_state *fs) {
 	/* This isn't used on RPi, but should free memory on some devices. When
 	 * you call tfx_frame, you should be done with your shader compiles for
 	 * a good while, since that should only be done during init/loading. */
@@ -3092,100 +5812,72 @@ tfx_stats tfx_frame() {
 		CHECK(tfx_glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS));
 	}
 
-	GLuint vao;
-	if (tfx_glGenVertexArrays && tfx_glBindVertexArray) {
-		CHECK(tfx_glGenVertexArrays(1, &vao));
-		CHECK(tfx_glBindVertexArray(vao));
+	// anything could have happened to GL state since the last frame.
+	state_invalidate();
+	g_state.calls = 0;
+	g_state.skipped = 0;
+	// without vertex arrays the element binding is the app's too.
+	g_scratch_ibo = 0;
+
+	bool use_vaos = tfx_glGenVertexArrays && tfx_glBindVertexArray && tfx_glDeleteVertexArrays;
+	if (use_vaos && !g_scratch_vao) {
+		CHECK(tfx_glGenVertexArrays(1, &g_scratch_vao));
+	}
+	if (use_vaos) {
+		state_vao(g_scratch_vao);
 	}
+	// the scratch array's binding state is only tracked when it's a real, persistent one.
+	bool separate_formats = use_vaos && tfx_glVertexAttribFormat && tfx_glVertexAttribBinding && tfx_glBindVertexBuffer && tfx_glVertexBindingDivisor;
 
-	unsigned debug_id = 0;
+	// runs of compatible draws go out as one multi-draw, their commands start over every frame.
+	bool batch_draws = use_vaos && g_caps.multi_draw_indirect && tfx_glMultiDrawElementsIndirect && tfx_glMultiDrawArraysIndirect;
+	g_indirect.offset = 0;
 
-	// update the debug overlay, make sure to do this before texture update AND buffer update
-	if ((g_flags & TFX_RESET_DEBUG_OVERLAY) == TFX_RESET_DEBUG_OVERLAY && g_debug_data != NULL && g_debug_program) {
-		push_group(debug_id++, "Update Debug");
-		tfx_texture_update(&g_debug_overlay, g_debug_data);
+	unsigned debug_id = 0;
 
-		tfx_view_set_name(254, "Debug");
-		tfx_set_texture(&g_debug_texture, &g_debug_overlay, 0);
-		tfx_set_transient_buffer(screen_triangle());
-		tfx_set_state(TFX_STATE_RGB_WRITE | TFX_STATE_ALPHA_WRITE | TFX_STATE_BLEND_ALPHA | TFX_STATE_CULL_CCW);
-		// one before last view id, so you can draw over it if you absolutely must in the final slot.
-		tfx_submit(254, g_debug_program, false);
-		pop_group();
+	if (g_uniform_ring.ptr) {
+		uniform_ring_begin();
 	}
 
 	push_group(debug_id++, "Update Resources");
 
-	if (g_transient_buffer.offset > 0) {
-		CHECK(tfx_glBindBuffer(GL_ARRAY_BUFFER, g_transient_buffer.buffers[0].gl_id));
-		if (tfx_glMapBufferRange && tfx_glUnmapBuffer) {
-			// this is backed by multiple buffers, so invalidate might be pointless. need to profile.
-			void *ptr = tfx_glMapBufferRange(GL_ARRAY_BUFFER, 0, g_transient_buffer.offset, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
-			if (ptr) {
-				memcpy(ptr, g_transient_buffer.data, g_transient_buffer.offset);
-				CHECK(tfx_glUnmapBuffer(GL_ARRAY_BUFFER));
-			}
+	tvb_upload_chunks(GL_ARRAY_BUFFER, &fs->transient, g_transient_buffer.buffers[fs->transient_slot]);
+	// the scratch vertex array is bound, so this doesn't disturb any cached ones.
+	tvb_upload_chunks(GL_ELEMENT_ARRAY_BUFFER, &fs->transient_indices, g_transient_buffer.indices[fs->transient_slot]);
+
+	apply_buffer_updates(fs);
+
+	int ntu = sb_count(fs->texture_updates);
+	for (int i = 0; i < ntu; i++) {
+		tfx_texture_update_op *update = &fs->texture_updates[i];
+		// only the last update to a texture counts.
+		bool replaced = false;
+		for (int j = i + 1; j < ntu && !replaced; j++) {
+			replaced = fs->texture_updates[j].id == update->id;
 		}
-		else {
-			// orphan the buffer explicitly if mapping isn't available
-			CHECK(tfx_glBufferData(GL_ARRAY_BUFFER, TFX_TRANSIENT_BUFFER_SIZE, NULL, GL_DYNAMIC_DRAW));
-			CHECK(tfx_glBufferSubData(GL_ARRAY_BUFFER, 0, g_transient_buffer.offset, g_transient_buffer.data));
-		}
-	}
-
-	int nbb = sb_count(g_buffers);
-	for (int i = 0; i < nbb; i++) {
-		tfx_buffer *buf = &g_buffers[i];
-		tfx_buffer_params *params = (tfx_buffer_params*)buf->internal;
-		if (params) {
-			CHECK(tfx_glBindBuffer(GL_ARRAY_BUFFER, buf->gl_id));
-			if (tfx_glMapBufferRange && tfx_glUnmapBuffer) {
-				void *ptr = tfx_glMapBufferRange(GL_ARRAY_BUFFER, params->offset, params->size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
-				if (ptr) {
-					memcpy(ptr, params->update_data, params->size);
-					CHECK(tfx_glUnmapBuffer(GL_ARRAY_BUFFER));
-				}
-			}
-			else {
-				CHECK(tfx_glBufferData(GL_ARRAY_BUFFER, params->size, NULL, GL_DYNAMIC_DRAW));
-				CHECK(tfx_glBufferSubData(GL_ARRAY_BUFFER, params->offset, params->size, params->update_data));
-			}
-			free(params);
-			buf->internal = NULL;
+		tfx_texture *tex = find_texture(update->id);
+		if (replaced || !tex) {
+			continue;
 		}
-	}
-
-	int nt = sb_count(g_textures);
-	for (int i = 0; i < nt; i++) {
-		tfx_texture *tex = &g_textures[i];
 		tfx_texture_params *internal = tex->internal;
-		if (internal->update_data != NULL && (tex->flags & TFX_TEXTURE_CPU_WRITABLE) == TFX_TEXTURE_CPU_WRITABLE) {
-			assert((tex->flags & TFX_TEXTURE_CUBE) != TFX_TEXTURE_CUBE);
-			// spin the buffer id before updating
-			tex->gl_idx = (tex->gl_idx + 1) % tex->gl_count;
-			tfx_glBindTexture(GL_TEXTURE_2D, tex->gl_ids[tex->gl_idx]);
-			if (tfx_glInvalidateTexSubImage && !g_platform_data.use_gles) {
-				tfx_glInvalidateTexSubImage(tex->gl_ids[tex->gl_idx], 0, 0, 0, 0, tex->width, tex->height, 1);
-			}
-			tfx_glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tex->width, tex->height, internal->format, internal->type, internal->update_data);
-			internal->update_data = NULL;
+		assert((tex->flags & TFX_TEXTURE_CUBE) != TFX_TEXTURE_CUBE);
+		// spin the buffer id before updating
+		tex->gl_idx = (tex->gl_idx + 1) % tex->gl_count;
+		state_texture(0, GL_TEXTURE_2D, tex->gl_ids[tex->gl_idx]);
+		if (tfx_glInvalidateTexSubImage && !g_platform_data.use_gles) {
+			tfx_glInvalidateTexSubImage(tex->gl_ids[tex->gl_idx], 0, 0, 0, 0, tex->width, tex->height, 1);
 		}
+		tfx_glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tex->width, tex->height, internal->format, internal->type, update->data);
 	}
+	sb_clear(fs->texture_updates);
 
-	// clear debug pixel data for next frame
-	if ((g_flags & TFX_RESET_DEBUG_OVERLAY) == TFX_RESET_DEBUG_OVERLAY && g_debug_data != NULL) {
-		size_t pitch = (size_t)g_debug_overlay.width * 4;
-		size_t overlay_size = g_debug_overlay.height * pitch;
-		memset(g_debug_data, 0, overlay_size);
-	}
+	issue_uploads(&stats);
 
 	pop_group();
 
 	char debug_label[256];
 
 	tfx_canvas *last_canvas = NULL;
-	int last_count = 0;
-	GLuint last_program = 0;
 	GLuint64 last_result = 0;
 
 	// flip active timers every other frame. we get results from previous frame.
@@ -3196,11 +5888,11 @@ tfx_stats tfx_frame() {
 	bool in_group = false;
 
 	for (int id = 0; id < VIEW_MAX; id++) {
-		tfx_view *view = &g_back.views[id];
+		tfx_view *view = &fs->views[id];
 
-		int nd = sb_count(view->draws);
-		int cd = sb_count(view->jobs);
-		if (nd == 0 && cd == 0) {
+		int nd, cd;
+		count_draws(fs, id, &nd, &cd);
+		if (nd == 0 && cd == 0 && sb_count(view->copies) == 0) {
 			continue;
 		}
 
@@ -3284,7 +5976,7 @@ tfx_stats tfx_frame() {
 			int offset = 0;
 			for (unsigned i = 0; i < last_canvas->allocated; i++) {
 				tfx_texture *attachment = &last_canvas->attachments[i];
-				CHECK(tfx_glBindTexture(GL_TEXTURE_2D, attachment->gl_ids[0]));
+				state_texture(0, GL_TEXTURE_2D, attachment->gl_ids[0]);
 				CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0));
 				CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, attachment->mip_count-1));
 
@@ -3325,8 +6017,8 @@ tfx_stats tfx_frame() {
 					mask |= GL_COLOR_BUFFER_BIT;
 				}
 			}
-			CHECK(tfx_glBindFramebuffer(GL_DRAW_FRAMEBUFFER, last_canvas->gl_fbo[0]));
-			CHECK(tfx_glBindFramebuffer(GL_READ_FRAMEBUFFER, last_canvas->gl_fbo[1]));
+			state_framebuffer(GL_DRAW_FRAMEBUFFER, last_canvas->gl_fbo[0]);
+			state_framebuffer(GL_READ_FRAMEBUFFER, last_canvas->gl_fbo[1]);
 			CHECK(tfx_glBlitFramebuffer(
 				0, 0, last_canvas->width, last_canvas->height, // src
 				0, 0, last_canvas->width, last_canvas->height, // dst
@@ -3339,7 +6031,7 @@ tfx_stats tfx_frame() {
 		if (nb > 0) {
 			for (int b = 0; b < nb; b++) {
 				tfx_blit_op *blit = &view->blits[b];
-				tfx_canvas *src = blit->source;
+				tfx_canvas *src = get_canvas(&fs->views[blit->source_view]);
 				if (tfx_glCopyImageSubData) {
 					int argh = 0;
 					if (canvas->attachments[0].is_depth || canvas->attachments[0].is_stencil) {
@@ -3353,8 +6045,8 @@ tfx_stats tfx_frame() {
 						blit->rect.w, blit->rect.h, 1
 					));
 				} else {
-					CHECK(tfx_glBindFramebuffer(GL_DRAW_FRAMEBUFFER, canvas->msaa ? canvas->gl_fbo[1] : canvas->gl_fbo[0]));
-					CHECK(tfx_glBindFramebuffer(GL_READ_FRAMEBUFFER, src->msaa ? src->gl_fbo[1] : src->gl_fbo[0]));
+					state_framebuffer(GL_DRAW_FRAMEBUFFER, canvas->msaa ? canvas->gl_fbo[1] : canvas->gl_fbo[0]);
+					state_framebuffer(GL_READ_FRAMEBUFFER, src->msaa ? src->gl_fbo[1] : src->gl_fbo[0]);
 					if (blit->source_mip != src->current_mip) {
 						// TODO: calculate correct dest size, update mip bindings
 						assert(0);
@@ -3369,65 +6061,70 @@ tfx_stats tfx_frame() {
 			}
 		}
 
+		// buffer copies go before compute, so jobs can reset their counters.
+		int nc = sb_count(view->copies);
+		if (nc > 0) {
+			issue_copies(view->copies, nc);
+			// views without draws stop early, don't leave these for the next frame.
+			sb_clear(view->copies);
+		}
+
 		// run compute after blit so compute can rely on msaa being resolved first.
 		if (g_caps.compute && cd > 0) {
+			tfx_sort_item *jobs = collect_draws(fs, id, cd, true);
 			for (int i = 0; i < cd; i++) {
-				tfx_draw job = view->jobs[i];
-				if (job.program != last_program) {
-					CHECK(tfx_glUseProgram(job.program));
-					last_program = job.program;
-				}
-
-				for (int j = 0; j < 8; j++) {
-					// make sure writing to image has finished before read
-					tfx_texture *tex = &job.textures[j];
-					GLuint id = tex->gl_ids[tex->gl_idx];
-					if (id != 0) {
-						static PFNGLBINDIMAGETEXTUREPROC tfx_glBindImageTexture = NULL;
-						if (!tfx_glBindImageTexture) {
-							tfx_glBindImageTexture = g_platform_data.gl_get_proc_address("glBindImageTexture");
-						}
-						if (tex->dirty) {
-							CHECK(tfx_glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT));
-							tex->dirty = false;
+				tfx_draw *job = jobs[i].draw;
+				tfx_encoder *enc = item_encoder(fs, &jobs[i]);
+				state_program(job->program);
+
+				if (job->bindings != TFXI_NONE) {
+					tfx_bindings *b = &enc->bindings[job->bindings];
+
+					// make sure writing to images and buffers has finished before read
+					memory_barrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+					for (int j = 0; j < 8; j++) {
+						if (b->textures[j] != 0) {
+							static PFNGLBINDIMAGETEXTUREPROC tfx_glBindImageTexture = NULL;
+							if (!tfx_glBindImageTexture) {
+								tfx_glBindImageTexture = g_platform_data.gl_get_proc_address("glBindImageTexture");
+							}
+							bool write = (b->textures_write & (1 << j)) != 0;
+							if (write) {
+								g_pending_barriers |= GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT;
+							}
+							GLenum fmt = b->formats[j];
+							switch (fmt) {
+								case GL_DEPTH_COMPONENT16: fmt = GL_R16F; break;
+								case GL_DEPTH_COMPONENT24: assert(0); break;
+								case GL_DEPTH_COMPONENT32: fmt = GL_R32F; break;
+								default: break;
+							}
+							bool cube = b->targets[j] == GL_TEXTURE_CUBE_MAP;
+							CHECK(tfx_glBindImageTexture(j, b->textures[j], b->mips[j], cube, 0, write ? GL_WRITE_ONLY : GL_READ_ONLY, fmt));
 						}
-						bool write = job.textures_write[j];
-						if (write) {
-							tex->dirty = true;
+						if (b->buffers[j] != 0) {
+							if ((b->buffers_write & (1 << j)) != 0) {
+								g_pending_barriers |= GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT;
+							}
+							state_storage_buffer(j, b->buffers[j], b->buffer_offsets[j], b->buffer_sizes[j]);
 						}
-						tfx_texture_params *internal = (tfx_texture_params*)tex->internal;
-						GLenum fmt = internal->internal_format;
-						switch (fmt) {
-							case GL_DEPTH_COMPONENT16: fmt = GL_R16F; break;
-							case GL_DEPTH_COMPONENT24: assert(0); break;
-							case GL_DEPTH_COMPONENT32: fmt = GL_R32F; break;
-							default: break;
+						else {
+							//CHECK(tfx_glBindBufferBase(GL_SHADER_STORAGE_BUFFER, j, 0));
 						}
-						bool cube = (tex->flags & TFX_TEXTURE_CUBE) == TFX_TEXTURE_CUBE;
-						CHECK(tfx_glBindImageTexture(j, tex->gl_ids[tex->gl_idx], job.textures_mip[j], cube, 0, write ? GL_WRITE_ONLY : GL_READ_ONLY, fmt));
-					}
-					if (job.ssbos[j].gl_id != 0) {
-						tfx_buffer *ssbo = &job.ssbos[j];
-						if (ssbo->dirty) {
-							CHECK(tfx_glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT));
-							ssbo->dirty = false;
-						}
-						if (job.ssbo_write[j]) {
-							ssbo->dirty = true;
-						}
-						CHECK(tfx_glBindBufferBase(GL_SHADER_STORAGE_BUFFER, j, job.ssbos[j].gl_id));
-					}
-					else {
-						//CHECK(tfx_glBindBufferBase(GL_SHADER_STORAGE_BUFFER, j, 0));
 					}
 				}
-				update_uniforms(&job);
-				CHECK(tfx_glDispatchCompute(job.threads_x, job.threads_y, job.threads_z));
-				sb_free(job.uniforms);
-				job.uniforms = NULL;
+				update_uniforms(fs, &jobs[i], &stats);
+				if (job->indirect) {
+					// the arguments may have been written by an earlier job.
+					memory_barrier(GL_COMMAND_BARRIER_BIT);
+					state_buffer(GL_DISPATCH_INDIRECT_BUFFER, &g_state.dispatch_buffer, job->indirect);
+					CHECK(tfx_glDispatchComputeIndirect((GLintptr)job->indirect_offset));
+				}
+				else {
+					CHECK(tfx_glDispatchCompute(job->threads_x, job->threads_y, job->threads_z));
+				}
 			}
-			sb_free(view->jobs);
-			view->jobs = NULL;
 		}
 
 		// TODO: defer framebuffer creation
@@ -3437,14 +6134,14 @@ tfx_stats tfx_frame() {
 		}
 
 		if (canvas->reconfigure) {
-			CHECK(tfx_glBindFramebuffer(GL_FRAMEBUFFER, canvas->gl_fbo[0]));
+			state_framebuffer(GL_FRAMEBUFFER, canvas->gl_fbo[0]);
 			canvas_reconfigure(canvas, false);
 			canvas->reconfigure = false;
 		}
 
 		// TODO: can't render to individual cube face mips with msaa this way
 		bool bind_msaa = canvas->msaa && view->canvas_layer <= 0;
-		CHECK(tfx_glBindFramebuffer(GL_FRAMEBUFFER, bind_msaa ? canvas->gl_fbo[1] : canvas->gl_fbo[0]));
+		state_framebuffer(GL_FRAMEBUFFER, bind_msaa ? canvas->gl_fbo[1] : canvas->gl_fbo[0]);
 
 		if (view->canvas_layer >= 0 && canvas->current_mip != view->canvas_layer && !canvas->cube) {
 			int offset = 0;
@@ -3475,7 +6172,7 @@ tfx_stats tfx_frame() {
 				CHECK(tfx_glFramebufferTexture2D(GL_FRAMEBUFFER, attach, GL_TEXTURE_2D, attachment->gl_ids[0], canvas->current_mip));
 
 				// bind next level for rendering but first restrict fetches only to previous level
-				CHECK(tfx_glBindTexture(GL_TEXTURE_2D, attachment->gl_ids[0]));
+				state_texture(0, GL_TEXTURE_2D, attachment->gl_ids[0]);
 				CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, canvas->current_mip-1));
 				CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, canvas->current_mip-1));
 			}
@@ -3491,15 +6188,19 @@ tfx_stats tfx_frame() {
 		}
 
 		// TODO: render whole view multiple times if this is unavailable?
-		if (tfx_glViewportIndexedf) {
+		if (tfx_glViewportIndexedf && view->viewport_count > 1) {
 			for (int v = 0; v < view->viewport_count; v++) {
 				tfx_rect *vp = &view->viewports[v];
 				CHECK(tfx_glViewportIndexedf(v, (float)vp->x, (float)vp->y, (float)vp->w, (float)vp->h));
 			}
+			// the first one is the same as glViewport.
+			tfx_rect *vp = &view->viewports[0];
+			GLint first[4] = { vp->x, vp->y, vp->w, vp->h };
+			memcpy(g_state.viewport, first, sizeof(first));
 		}
 		else {
 			tfx_rect *vp = &view->viewports[0];
-			CHECK(tfx_glViewport(vp->x, vp->y, vp->w, vp->h));
+			state_viewport(vp->x, vp->y, vp->w, vp->h);
 		}
 
 		// TODO: caps flags for texture array support
@@ -3540,7 +6241,7 @@ tfx_stats tfx_frame() {
 				if ((attachment->flags & TFX_TEXTURE_GEN_MIPS) != TFX_TEXTURE_GEN_MIPS) {
 					continue;
 				}
-				tfx_glBindTexture(fmt, attachment->gl_ids[attachment->gl_idx]);
+				state_texture(0, fmt, attachment->gl_ids[attachment->gl_idx]);
 				tfx_glGenerateMipmap(fmt);
 			}
 		}
@@ -3548,11 +6249,11 @@ tfx_stats tfx_frame() {
 
 		if (view->flags & TFXI_VIEW_SCISSOR) {
 			tfx_rect rect = view->scissor_rect;
-			CHECK(tfx_glEnable(GL_SCISSOR_TEST));
-			CHECK(tfx_glScissor(rect.x, canvas->height - rect.y - rect.h, rect.w, rect.h));
+			state_enable(GL_SCISSOR_TEST, &g_state.scissor_test, true);
+			state_scissor(rect.x, canvas->height - rect.y - rect.h, rect.w, rect.h);
 		}
 		else {
-			CHECK(tfx_glDisable(GL_SCISSOR_TEST));
+			state_enable(GL_SCISSOR_TEST, &g_state.scissor_test, false);
 		}
 
 		GLuint mask = 0;
@@ -3565,14 +6266,14 @@ tfx_stats tfx_frame() {
 				((color >>  8) & 0xff) / 255.0f,
 				((color >>  0) & 0xff) / 255.0f
 			};
-			CHECK(tfx_glClearColor(c[0], c[1], c[2], c[3]));
-			CHECK(tfx_glColorMask(true, true, true, true));
+			state_clear_color(c[0], c[1], c[2], c[3]);
+			state_color_mask(true, true, true, true);
 		}
 
 		if (view->flags & TFXI_VIEW_CLEAR_DEPTH) {
 			mask |= GL_DEPTH_BUFFER_BIT;
-			CHECK(tfx_glClearDepthf(view->clear_depth));
-			CHECK(tfx_glDepthMask(true));
+			state_clear_depth(view->clear_depth);
+			state_depth_mask(true);
 		}
 
 		if (mask != 0) {
@@ -3580,111 +6281,91 @@ tfx_stats tfx_frame() {
 		}
 
 		if (view->flags & TFXI_VIEW_DEPTH_TEST_MASK) {
-			CHECK(tfx_glEnable(GL_DEPTH_TEST));
+			state_enable(GL_DEPTH_TEST, &g_state.depth_test, true);
 			if (view->flags & TFXI_VIEW_DEPTH_TEST_LT) {
-				CHECK(tfx_glDepthFunc(GL_LEQUAL));
+				state_depth_func(GL_LEQUAL);
 			}
 			else if (view->flags & TFXI_VIEW_DEPTH_TEST_GT) {
-				CHECK(tfx_glDepthFunc(GL_GEQUAL));
+				state_depth_func(GL_GEQUAL);
 			}
 			else if (view->flags & TFXI_VIEW_DEPTH_TEST_EQ) {
-				CHECK(tfx_glDepthFunc(GL_EQUAL));
+				state_depth_func(GL_EQUAL);
 			}
 		}
 		else {
-			CHECK(tfx_glDisable(GL_DEPTH_TEST));
+			state_enable(GL_DEPTH_TEST, &g_state.depth_test, false);
 		}
 
-#define CHANGED(diff, mask) ((diff & mask) != 0)
+		tfx_sort_item *order = collect_draws(fs, id, nd, false);
 
-		uint64_t last_flags = 0;
 		for (int i = 0; i < nd; i++) {
-			tfx_draw draw = view->draws[i];
-			if (draw.program != last_program) {
-				CHECK(tfx_glUseProgram(draw.program));
-				last_program = draw.program;
-			}
-
-			// on first iteration of a pass, make sure to set everything.
-			if (i == 0) {
-				last_flags = ~draw.flags;
-			}
+			tfx_draw *draw = order[i].draw;
+			tfx_encoder *enc = item_encoder(fs, &order[i]);
+			state_program(draw->program);
 
-			// simple flag diff cuts total GL calls by approx 20% in testing
-			uint64_t flags_diff = draw.flags ^ last_flags;
-			last_flags = draw.flags;
+			// the state cache only makes the calls which change something.
+			state_depth_mask((draw->flags & TFX_STATE_DEPTH_WRITE) == TFX_STATE_DEPTH_WRITE);
 
-			if (CHANGED(flags_diff, TFX_STATE_DEPTH_WRITE)) {
-				CHECK(tfx_glDepthMask((draw.flags & TFX_STATE_DEPTH_WRITE) == TFX_STATE_DEPTH_WRITE));
+			if (g_caps.multisample) {
+				state_enable(GL_MULTISAMPLE, &g_state.multisample, (draw->flags & TFX_STATE_MSAA) != 0);
 			}
 
-			if (CHANGED(flags_diff, TFX_STATE_MSAA) && g_caps.multisample) {
-				if (draw.flags & TFX_STATE_MSAA) {
-					CHECK(tfx_glEnable(GL_MULTISAMPLE));
-				}
-				else {
-					CHECK(tfx_glDisable(GL_MULTISAMPLE));
-				}
+			if (draw->flags & TFX_STATE_CULL_CW) {
+				state_enable(GL_CULL_FACE, &g_state.cull, true);
+				state_front_face(GL_CW);
 			}
-
-			if (CHANGED(flags_diff, TFXI_STATE_CULL_MASK)) {
-				if (draw.flags & TFX_STATE_CULL_CW) {
-					CHECK(tfx_glEnable(GL_CULL_FACE));
-					CHECK(tfx_glFrontFace(GL_CW));
-				}
-				else if (draw.flags & TFX_STATE_CULL_CCW) {
-					CHECK(tfx_glEnable(GL_CULL_FACE));
-					CHECK(tfx_glFrontFace(GL_CCW));
-				}
-				else {
-					CHECK(tfx_glDisable(GL_CULL_FACE));
-				}
+			else if (draw->flags & TFX_STATE_CULL_CCW) {
+				state_enable(GL_CULL_FACE, &g_state.cull, true);
+				state_front_face(GL_CCW);
+			}
+			else {
+				state_enable(GL_CULL_FACE, &g_state.cull, false);
 			}
 
-			if (CHANGED(flags_diff, TFXI_STATE_BLEND_MASK)) {
-				if (draw.flags & TFXI_STATE_BLEND_MASK) {
-					CHECK(tfx_glEnable(GL_BLEND));
-					if (draw.flags & TFX_STATE_BLEND_ALPHA) {
-						CHECK(tfx_glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
-					}
-				}
-				else {
-					CHECK(tfx_glDisable(GL_BLEND));
+			if (draw->flags & TFXI_STATE_BLEND_MASK) {
+				state_enable(GL_BLEND, &g_state.blend, true);
+				if (draw->flags & TFX_STATE_BLEND_ALPHA) {
+					state_blend_func(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 				}
 			}
-
-			if (CHANGED(flags_diff, TFX_STATE_RGB_WRITE) || CHANGED(flags_diff, TFX_STATE_ALPHA_WRITE)) {
-				bool write_rgb = (draw.flags & TFX_STATE_RGB_WRITE) == TFX_STATE_RGB_WRITE;
-				bool write_alpha = (draw.flags & TFX_STATE_ALPHA_WRITE) == TFX_STATE_ALPHA_WRITE;
-				CHECK(tfx_glColorMask(write_rgb, write_rgb, write_rgb, write_alpha));
+			else {
+				state_enable(GL_BLEND, &g_state.blend, false);
 			}
 
-			if ((view->flags & TFXI_VIEW_SCISSOR) || draw.use_scissor) {
-				CHECK(tfx_glEnable(GL_SCISSOR_TEST));
+			bool write_rgb = (draw->flags & TFX_STATE_RGB_WRITE) == TFX_STATE_RGB_WRITE;
+			bool write_alpha = (draw->flags & TFX_STATE_ALPHA_WRITE) == TFX_STATE_ALPHA_WRITE;
+			state_color_mask(write_rgb, write_rgb, write_rgb, write_alpha);
+
+			if ((view->flags & TFXI_VIEW_SCISSOR) || draw->use_scissor) {
+				state_enable(GL_SCISSOR_TEST, &g_state.scissor_test, true);
 				tfx_rect rect = view->scissor_rect;
-				if (draw.use_scissor) {
-					rect = draw.scissor_rect;
+				if (draw->use_scissor) {
+					rect = draw->scissor_rect;
 				}
-				CHECK(tfx_glScissor(rect.x, canvas->height - rect.y - rect.h, rect.w, rect.h));
+				state_scissor(rect.x, canvas->height - rect.y - rect.h, rect.w, rect.h);
 			}
 			else {
-				CHECK(tfx_glDisable(GL_SCISSOR_TEST));
+				state_enable(GL_SCISSOR_TEST, &g_state.scissor_test, false);
 			}
 
-			update_uniforms(&draw);
+			update_uniforms(fs, &order[i], &stats);
 
-			if (draw.callback != NULL) {
-				draw.callback();
+			if (draw->callback != NULL) {
+				draw->callback();
+				// it may have changed anything.
+				state_invalidate();
+				g_scratch_has_format = false;
+				g_scratch_vbo = 0;
+				g_scratch_instance_vbo = 0;
+				g_scratch_ibo = 0;
 			}
 
-			if (!draw.use_vbo && !draw.use_ibo) {
-				sb_free(draw.uniforms);
-				draw.uniforms = NULL;
+			if (!draw->use_vbo && !draw->use_ibo && !draw->indirect) {
 				continue;
 			}
 
 			GLenum mode = GL_TRIANGLES;
-			switch (draw.flags & TFXI_STATE_DRAW_MASK) {
+			switch (draw->flags & TFXI_STATE_DRAW_MASK) {
 				case TFX_STATE_DRAW_POINTS:     mode = GL_POINTS; break;
 				case TFX_STATE_DRAW_LINES:      mode = GL_LINES; break;
 				case TFX_STATE_DRAW_LINE_STRIP: mode = GL_LINE_STRIP; break;
@@ -3695,115 +6376,116 @@ tfx_stats tfx_frame() {
 			}
 
 			// not available on gles
-			if (CHANGED(flags_diff, TFX_STATE_WIREFRAME) && !g_platform_data.use_gles) {
-				if (draw.flags & TFX_STATE_WIREFRAME) {
-					CHECK(tfx_glPolygonMode(GL_FRONT_AND_BACK, GL_LINE));
-				}
-				else {
-					CHECK(tfx_glPolygonMode(GL_FRONT_AND_BACK, GL_FILL));
-				}
+			if (!g_platform_data.use_gles) {
+				state_polygon_mode((draw->flags & TFX_STATE_WIREFRAME) ? GL_LINE : GL_FILL);
 			}
 
-			if (draw.use_vbo) {
-				GLuint vbo = draw.vbo.gl_id;
-	#ifdef TFX_DEBUG
-				assert(vbo != 0);
-	#endif
-
-				if (draw.vbo.dirty && tfx_glMemoryBarrier) {
-					CHECK(tfx_glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT));
-					draw.vbo.dirty = false;
-				}
+			// meshes in regular buffers get a cached vertex array, everything else is set up on the scratch one.
+			bool cached = use_vaos && draw->use_vbo && !draw->use_tvb && !draw->use_tib;
+			if (draw->use_vbo || draw->instance_vbo) {
+				memory_barrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+			}
+			if (draw->use_ibo) {
+				memory_barrier(GL_ELEMENT_ARRAY_BARRIER_BIT);
+			}
 
-				uint32_t va_offset = 0;
-				if (draw.use_tvb) {
-					draw.vbo.format = draw.tvb_fmt;
-					va_offset = draw.offset;
-				}
-				tfx_vertex_format *fmt = &draw.vbo.format;
-				assert(fmt != NULL);
+			// a stream which isn't used has a zeroed format, so the scratch array can compare them.
+			static tfx_vertex_format no_format;
+			tfx_vertex_format *fmt = draw->use_vbo ? &enc->formats[draw->format] : &no_format;
+			tfx_vertex_format *instance_fmt = draw->instance_vbo ? &enc->formats[draw->instance_format] : &no_format;
+			GLuint divisor = instance_fmt->divisor ? instance_fmt->divisor : 1;
+			if (draw->use_vbo) {
 				assert(fmt->stride > 0);
+			}
 
-				CHECK(tfx_glBindBuffer(GL_ARRAY_BUFFER, vbo));
+			if (cached) {
+				state_vao(find_vao(draw->vbo, draw->use_ibo ? draw->ibo : 0, fmt, draw->instance_vbo, instance_fmt));
+			}
+			else {
+				if (use_vaos) {
+					state_vao(g_scratch_vao);
+				}
 
-				int nc = fmt->count;
-	#ifdef TFX_DEBUG
-				assert(nc < 8); // the mask is only 8 bits
-	#endif
+				// the transient buffers rotate as frames execute, so pick the current one here.
+				GLuint vbo = draw->use_tvb ? g_transient_buffer.buffers[fs->transient_slot][draw->tvb_chunk].gl_id : draw->vbo;
+				uint32_t va_offset = draw->use_tvb ? draw->offset : 0;
+#ifdef TFX_DEBUG
+				assert(!draw->use_vbo || vbo != 0);
+#endif
 
-				int real = 0;
-				for (int i = 0; i < nc; i++) {
-					if ((fmt->component_mask & (1 << i)) == 0) {
-						continue;
+				// vertices read from binding 0 and instances from binding 1.
+				if (separate_formats) {
+					bool same_format = g_scratch_has_format
+						&& memcmp(&g_scratch_format, fmt, sizeof(tfx_vertex_format)) == 0
+						&& memcmp(&g_scratch_instance_format, instance_fmt, sizeof(tfx_vertex_format)) == 0;
+					if (!same_format) {
+						int count = setup_attribs(fmt, 0, 0, 0, true, 0, NULL);
+						count = setup_attribs(instance_fmt, count, 0, 0, true, 1, NULL);
+						enable_attribs(count, &g_scratch_attribs);
+						if (draw->instance_vbo) {
+							CHECK(tfx_glVertexBindingDivisor(1, divisor));
+						}
+						g_scratch_format = *fmt;
+						g_scratch_instance_format = *instance_fmt;
+						g_scratch_has_format = true;
+						// the strides may have changed too.
+						g_scratch_vbo = 0;
+						g_scratch_instance_vbo = 0;
 					}
-					tfx_vertex_component vc = fmt->components[i];
-					GLenum gl_type = GL_FLOAT;
-					switch (vc.type) {
-						case TFX_TYPE_SKIP: continue;
-						case TFX_TYPE_UBYTE:  gl_type = GL_UNSIGNED_BYTE; break;
-						case TFX_TYPE_BYTE:   gl_type = GL_BYTE; break;
-						case TFX_TYPE_USHORT: gl_type = GL_UNSIGNED_SHORT; break;
-						case TFX_TYPE_SHORT:  gl_type = GL_SHORT; break;
-						case TFX_TYPE_FLOAT: break;
-						default: assert(0); break;
+					if (draw->use_vbo && (vbo != g_scratch_vbo || va_offset != g_scratch_offset)) {
+						CHECK(tfx_glBindVertexBuffer(0, vbo, va_offset, (GLsizei)fmt->stride));
+						g_scratch_vbo = vbo;
+						g_scratch_offset = va_offset;
 					}
-					if (i >= last_count) {
-						CHECK(tfx_glEnableVertexAttribArray(real));
+					if (draw->instance_vbo && draw->instance_vbo != g_scratch_instance_vbo) {
+						CHECK(tfx_glBindVertexBuffer(1, draw->instance_vbo, 0, (GLsizei)instance_fmt->stride));
+						g_scratch_instance_vbo = draw->instance_vbo;
 					}
-					CHECK(tfx_glVertexAttribPointer(real, (GLint)vc.size, gl_type, vc.normalized, (GLsizei)fmt->stride, (GLvoid*)(vc.offset + va_offset)));
-					real += 1;
 				}
-
-				last_count = last_count < 0 ? 0 : last_count;
-				nc = last_count - nc;
-				for (int i = 0; i <= nc; i++) {
-					CHECK(tfx_glDisableVertexAttribArray(last_count - i));
+				else {
+					int count = 0;
+					if (draw->use_vbo) {
+						state_array_buffer(vbo);
+						count = setup_attribs(fmt, 0, va_offset, 0, false, 0, &g_scratch_divided);
+					}
+					if (draw->instance_vbo) {
+						state_array_buffer(draw->instance_vbo);
+						count = setup_attribs(instance_fmt, count, 0, divisor, false, 0, &g_scratch_divided);
+					}
+					enable_attribs(count, &g_scratch_attribs);
 				}
-				last_count = real;
-			}
-			else if (last_count > 0) {
-				last_count = 0;
-				for (int i = 0; i < 8; i++) {
-					CHECK(tfx_glDisableVertexAttribArray(i));
+
+				if (draw->use_ibo) {
+					GLuint ibo = draw->use_tib ? g_transient_buffer.indices[fs->transient_slot][draw->tib_chunk].gl_id : draw->ibo;
+					if (state_changed(ibo != g_scratch_ibo)) {
+						CHECK(tfx_glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo));
+						g_scratch_ibo = ibo;
+					}
 				}
 			}
 
-			GLuint bind_units[8];
+			// bind nothing for draws without any, same as binding zeroes.
+			static tfx_bindings no_bindings;
+			tfx_bindings *b = &no_bindings;
+			if (draw->bindings != TFXI_NONE) {
+				b = &enc->bindings[draw->bindings];
+				memory_barrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+			}
 			for (int i = 0; i < 8; i++) {
-				tfx_buffer *ssbo = &draw.ssbos[i];
-				if (ssbo->gl_id != 0) {
-					if (ssbo->dirty) {
-						CHECK(tfx_glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT));
-						ssbo->dirty = false;
+				if (b->buffers[i] != 0) {
+					if ((b->buffers_write & (1 << i)) != 0) {
+						g_pending_barriers |= GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT;
 					}
-					if (draw.ssbo_write[i]) {
-						ssbo->dirty = true;
-					}
-					CHECK(tfx_glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, draw.ssbos[i].gl_id));
+					state_storage_buffer(i, b->buffers[i], b->buffer_offsets[i], b->buffer_sizes[i]);
 				}
 
-				tfx_texture *tex = &draw.textures[i];
-				bool msaa_sample = (tex->flags & TFX_TEXTURE_MSAA_SAMPLE) == TFX_TEXTURE_MSAA_SAMPLE;
-				GLuint idx = msaa_sample ? 1 : tex->gl_idx;
-				GLuint id = tex->gl_ids[idx];
-				bind_units[i] = id;
+				GLuint id = b->textures[i];
 				if (!g_caps.multibind && id > 0) {
-					CHECK(tfx_glActiveTexture(GL_TEXTURE0 + i));
-
-					bool cube = (tex->flags & TFX_TEXTURE_CUBE) == TFX_TEXTURE_CUBE;
-					GLenum fmt = cube ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
-					if (tex->depth > 1) {
-						assert(fmt != GL_TEXTURE_CUBE_MAP);
-						fmt = GL_TEXTURE_2D_ARRAY;
-					}
-					if (msaa_sample) {
-						fmt = GL_TEXTURE_2D_MULTISAMPLE;
-					}
-					CHECK(tfx_glBindTexture(fmt, id));
+					state_texture(i, b->targets[i], id);
 				}
 			}
 			if (g_caps.multibind) {
-				CHECK(tfx_glBindTextures(0, 8, bind_units));
+				state_textures(b->textures, b->targets);
 			}
 
 			int instance_mul = view->instance_mul;
@@ -3821,36 +6503,66 @@ tfx_stats tfx_frame() {
 				}
 			}
 
-			if (draw.use_ibo) {
-				if (draw.ibo.dirty && tfx_glMemoryBarrier) {
-					CHECK(tfx_glMemoryBarrier(GL_ELEMENT_ARRAY_BARRIER_BIT));
-					draw.ibo.dirty = false;
+			if (draw->indirect) {
+				memory_barrier(GL_COMMAND_BARRIER_BIT);
+				state_indirect_buffer(draw->indirect);
+				issue_indirect(draw, mode, &stats);
+				continue;
+			}
+
+			int run = 1;
+			if (batch_draws) {
+				while (i + run < nd && draws_batchable(fs, &order[i], &order[i + run])) {
+					run += 1;
+				}
+			}
+
+			stats.draw_calls += 1;
+			GLenum index_mode = draw->index_32 ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+			GLsizei instances = (draw->instances ? draw->instances : 1) * instance_mul;
+			if (run > 1) {
+				// everything else matches, so the commands only carry the ranges.
+				uint32_t index_size = draw->index_32 ? 4 : 2;
+				uint32_t stride = draw->use_tvb ? enc->formats[draw->format].stride : 0;
+				sb_clear(g_indirect.cmds);
+				tfx_indirect_cmd *cmds = sb_add(g_indirect.cmds, run);
+				for (int j = 0; j < run; j++) {
+					tfx_draw *d = order[i + j].draw;
+					cmds[j].count = d->indices;
+					cmds[j].instances = (d->instances ? d->instances : 1) * instance_mul;
+					cmds[j].first = 0;
+					cmds[j].base_vertex = 0;
+					cmds[j].base_instance = 0;
+					uint32_t first_vertex = d->use_tvb ? (d->offset - draw->offset) / stride : d->base_vertex;
+					if (d->use_ibo) {
+						cmds[j].first = d->index_offset / index_size;
+						cmds[j].base_vertex = first_vertex;
+					}
+					else {
+						cmds[j].first = first_vertex;
+					}
+				}
+				uintptr_t at = indirect_upload();
+				if (draw->use_ibo) {
+					CHECK(tfx_glMultiDrawElementsIndirect(mode, index_mode, (const void*)at, run, sizeof(tfx_indirect_cmd)));
 				}
-				CHECK(tfx_glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, draw.ibo.gl_id));
-				GLenum index_mode = GL_UNSIGNED_SHORT;
-				if ((draw.ibo.flags & TFX_BUFFER_INDEX_32) == TFX_BUFFER_INDEX_32) {
-					index_mode = GL_UNSIGNED_INT;
+				else {
+					CHECK(tfx_glMultiDrawArraysIndirect(mode, (const void*)at, run, sizeof(tfx_indirect_cmd)));
 				}
-				CHECK(tfx_glDrawElementsInstanced(mode, draw.indices, index_mode, (GLvoid*)draw.offset, 1*instance_mul));
+				i += run - 1;
+			}
+			else if (draw->use_ibo && draw->base_vertex > 0) {
+				CHECK(tfx_glDrawElementsInstancedBaseVertex(mode, draw->indices, index_mode, (GLvoid*)(uintptr_t)draw->index_offset, instances, (GLint)draw->base_vertex));
+			}
+			else if (draw->use_ibo) {
+				CHECK(tfx_glDrawElementsInstanced(mode, draw->indices, index_mode, (GLvoid*)(uintptr_t)draw->index_offset, instances));
 			}
 			else {
-				CHECK(tfx_glDrawArraysInstanced(mode, 0, (GLsizei)draw.indices, 1*instance_mul));
+				CHECK(tfx_glDrawArraysInstanced(mode, (GLint)draw->base_vertex, (GLsizei)draw->indices, instances));
 			}
-
-			sb_free(draw.uniforms);
-			draw.uniforms = NULL;
 		}
 
-#undef CHANGED
-
-		sb_free(view->jobs);
-		view->jobs = NULL;
-
-		sb_free(view->draws);
-		view->draws = NULL;
-
-		sb_free(view->blits);
-		view->blits = NULL;
+		sb_clear(view->blits);
 	}
 
 	pop_group();
@@ -3873,35 +6585,172 @@ tfx_stats tfx_frame() {
 
 	g_timer_offset = next_offset;
 
-	reset();
+	for (int i = 0; i < TFX_ENCODER_MAX+1; i++) {
+		encoder_flush(&fs->encoders[i]);
+	}
+
+	int nbf = sb_count(fs->bundle_frees);
+	for (int i = 0; i < nbf; i++) {
+		bundle_release(fs->bundle_frees[i]);
+	}
+	sb_clear(fs->bundle_frees);
+
+	stats.transient_bytes = fs->transient.offset + fs->transient_indices.offset;
+	stats.transient_dropped = fs->transient.dropped + fs->transient_indices.dropped;
+	if (stats.transient_bytes > g_transient_buffer.peak) {
+		g_transient_buffer.peak = stats.transient_bytes;
+	}
+	stats.transient_peak = g_transient_buffer.peak;
+	fs->transient.offset = 0;
+	fs->transient.dropped = 0;
+	fs->transient_indices.offset = 0;
+	fs->transient_indices.dropped = 0;
+
+	if (g_uniform_ring.ptr) {
+		uniform_ring_fence();
+	}
+
+	state_enable(GL_SCISSOR_TEST, &g_state.scissor_test, false);
+	state_color_mask(true, true, true, true);
+
+	// leave the scratch array bound, so buffer binds outside of frames can't touch cached ones.
+	if (use_vaos) {
+		state_vao(g_scratch_vao);
+	}
+
+	stats.state_changes = g_state.calls;
+	stats.state_skipped = g_state.skipped;
+
+	// mapped slots are written by the app directly, so they need fencing. the
+	// next frame records into the following slot, or the one after that if the
+	// render thread lets the app run a frame ahead.
+	if (g_transient_buffer.persistent) {
+		tvb_fence(fs->transient_slot);
+		tvb_wait((fs->transient_slot + (g_render_thread ? 2 : 1)) % TFX_TRANSIENT_BUFFER_COUNT);
+	}
+	stats.fence_stalls = g_fence_stalls;
+	g_fence_stalls = 0;
+
+	return stats;
+}
+
+// hand the recorded frame over to the render thread. it must be idle.
+static void swap_frame_state() {
+	for (int i = 0; i < VIEW_MAX; i++) {
+		tfx_view *back = &g_back.views[i];
+		tfx_view *front = &g_front.views[i];
+
+		// canvas mip tracking is updated as frames execute, carry it over
+		// like it would if there were only one copy of the view.
+		if (back->has_canvas && front->has_canvas && back->canvas.gl_fbo[0] == front->canvas.gl_fbo[0]) {
+			back->canvas.current_width = front->canvas.current_width;
+			back->canvas.current_height = front->canvas.current_height;
+			back->canvas.current_mip = front->canvas.current_mip;
+		}
+	}
+
+	// views are configured persistently, so the front gets a copy. blits are
+	// per frame, the lists trade places so both stay allocated.
+	for (int i = 0; i < VIEW_MAX; i++) {
+		tfx_blit_op *blits = g_front.views[i].blits;
+		tfx_copy_op *copies = g_front.views[i].copies;
+		g_front.views[i] = g_back.views[i];
+		g_back.views[i].blits = blits;
+		g_back.views[i].copies = copies;
+		sb_clear(blits);
+		sb_clear(copies);
+	}
+
+	// the front encoders were flushed when their frame finished, swap so
+	// their storage gets reused for recording.
+	for (int i = 0; i < TFX_ENCODER_MAX+1; i++) {
+		tfx_encoder tmp = g_front.encoders[i];
+		g_front.encoders[i] = g_back.encoders[i];
+		g_back.encoders[i] = tmp;
+	}
+
+	// each copy keeps its own chunks, the front one's were reset when its frame finished.
+	tfx_transient_data transient = g_front.transient;
+	g_front.transient = g_back.transient;
+	g_back.transient = transient;
+
+	transient = g_front.transient_indices;
+	g_front.transient_indices = g_back.transient_indices;
+	g_back.transient_indices = transient;
 
-	tvb_reset();
+	g_front.transient_slot = g_back.transient_slot;
+	tvb_next_slot(&g_back);
+
+	tfx_buffer_update_op *buffer_updates = g_front.buffer_updates;
+	g_front.buffer_updates = g_back.buffer_updates;
+	g_back.buffer_updates = buffer_updates;
+
+	uint8_t *update_data = g_front.update_data;
+	g_front.update_data = g_back.update_data;
+	g_back.update_data = update_data;
+
+	tfx_texture_update_op *texture_updates = g_front.texture_updates;
+	g_front.texture_updates = g_back.texture_updates;
+	g_back.texture_updates = texture_updates;
+
+	tfx_bundle **bundle_frees = g_front.bundle_frees;
+	g_front.bundle_frees = g_back.bundle_frees;
+	g_back.bundle_frees = bundle_frees;
+}
+
+tfx_stats tfx_frame() {
+	assert(did_you_call_tfx_reset);
 
-	sb_free(g_back.uniforms);
-	g_back.uniforms = NULL;
+	// update the debug overlay, make sure to do this before the frame is handed over
+	bool overlay = (g_flags & TFX_RESET_DEBUG_OVERLAY) == TFX_RESET_DEBUG_OVERLAY && g_debug_data != NULL && g_debug_program;
+	if (overlay) {
+		tfx_texture_update(&g_debug_overlay, g_debug_data);
 
-	g_back.ub_cursor = g_back.uniform_buffer;
+		tfx_view_set_name(254, "Debug");
+		tfx_set_texture(&g_debug_texture, &g_debug_overlay, 0);
+		tfx_set_transient_buffer(screen_triangle());
+		tfx_set_state(TFX_STATE_RGB_WRITE | TFX_STATE_ALPHA_WRITE | TFX_STATE_BLEND_ALPHA | TFX_STATE_CULL_CCW);
+		// one before last view id, so you can draw over it if you absolutely must in the final slot.
+		tfx_submit(254, g_debug_program, false);
+	}
 
-	CHECK(tfx_glDisable(GL_SCISSOR_TEST));
-	CHECK(tfx_glColorMask(true, true, true, true));
+	for (int i = 0; i < TFX_ENCODER_MAX+1; i++) {
+		// encoders must be ended before the frame is submitted.
+		assert(!g_back.encoders[i].active);
+	}
 
-	if (tfx_glDeleteVertexArrays) {
-		CHECK(tfx_glDeleteVertexArrays(1, &vao));
+	tfx_stats stats;
+	if (g_render_thread) {
+		// wait for the previous frame to finish, then hand this one over.
+		// stats are from the previous frame.
+		tfx_sem_wait(&g_render_done);
+		stats = g_render_stats;
+		memcpy(g_render_timings, last_timings, sizeof(tfx_timing_info)*VIEW_MAX);
+		stats.timings = g_render_timings;
+		swap_frame_state();
+		tfx_sem_post(&g_render_ready);
+	}
+	else {
+		stats = render_frame(&g_back);
+		tvb_next_slot(&g_back);
 	}
 
-	// shift buffers to avoid stalls
-	tfx_buffer tmp = g_transient_buffer.buffers[0];
-	for (int i = 0; i < TFX_TRANSIENT_BUFFER_COUNT - 1; i++) {
-		g_transient_buffer.buffers[i] = g_transient_buffer.buffers[i+1];
+	// keep plotting into the other buffer while this one is uploaded. the
+	// previous frame has finished with it by now, so it's safe to clear here.
+	if (overlay) {
+		uint32_t *tmp = g_debug_staged;
+		g_debug_staged = g_debug_data;
+		g_debug_data = tmp;
+		size_t pitch = (size_t)g_debug_overlay.width * 4;
+		memset(g_debug_data, 0, g_debug_overlay.height * pitch);
 	}
-	g_transient_buffer.buffers[TFX_TRANSIENT_BUFFER_COUNT-1] = tmp;
 
 	if ((g_flags & TFX_RESET_DEBUG_OVERLAY_STATS) == TFX_RESET_DEBUG_OVERLAY_STATS) {
 		int row = 0;
 
 		uint16_t color[2] = { 0x140f, 0x160f };
 
-		const char *str = tfx_sprintf("Draws: %5d", stats.draws);
+		const char *str = tfx_sprintf("Draws: %5d (%d calls)", stats.draws, stats.draw_calls);
 		int lrow = row; row++; // avoid warning from -Wunsequenced
 		tfx_debug_print(lrow, 0, color[row % 2], 0, str);
 		free((char*)str);
@@ -3911,6 +6760,16 @@ tfx_stats tfx_frame() {
 		tfx_debug_print(lrow, 0, color[row % 2], 0, str);
 		free((char*)str);
 
+		lrow = row; row++;
+		str = tfx_sprintf("Uniforms: %5d (%d skipped)", stats.uniforms, stats.uniforms_skipped);
+		tfx_debug_print(lrow, 0, color[row % 2], 0, str);
+		free((char*)str);
+
+		lrow = row; row++;
+		str = tfx_sprintf("State: %5d (%d skipped)", stats.state_changes, stats.state_skipped);
+		tfx_debug_print(lrow, 0, color[row % 2], 0, str);
+		free((char*)str);
+
 		int max_width = 0;
 		for (unsigned i = 0; i < stats.num_timings; i++) {
 			int len = strnlen(stats.timings[i].name, 100);
@@ -3941,6 +6800,30 @@ tfx_stats tfx_frame() {
 
 	return stats;
 }
+
+bool tfx_render_frame() {
+	assert(g_render_thread);
+
+	tfx_sem_wait(&g_render_ready);
+	if (g_render_quit) {
+		tfx_sem_post(&g_render_done);
+		return false;
+	}
+
+	g_render_stats = render_frame(&g_front);
+	tfx_sem_post(&g_render_done);
+
+	return true;
+}
+
+void tfx_render_stop() {
+	assert(g_render_thread);
+
+	// let the last frame finish first, so it isn't dropped.
+	tfx_sem_wait(&g_render_done);
+	g_render_quit = true;
+	tfx_sem_post(&g_render_ready);
+}
 #undef MAX_VIEW
 #undef CHECK
 
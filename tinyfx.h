@@ -16,6 +16,8 @@ typedef enum tfx_buffer_flags {
 	TFX_BUFFER_MUTABLE = 1 << 1,
 	// temporary (updated many times per frame)
 	// TFX_BUFFER_STREAM  = 1 << 2
+	// share a large GL buffer with others, so draws from different meshes can be batched.
+	TFX_BUFFER_SUBALLOCATE = 1 << 3
 } tfx_buffer_flags;
 
 typedef enum tfx_depth_test {
@@ -95,7 +97,13 @@ typedef enum tfx_reset_flags {
 	// be aware that it's pretty slow, since it just plots pixels on cpu.
 	// you probably don't want to leave this on if you're not using it!
 	TFX_RESET_DEBUG_OVERLAY = 1 << 2,
-	TFX_RESET_DEBUG_OVERLAY_STATS = 1 << 3
+	TFX_RESET_DEBUG_OVERLAY_STATS = 1 << 3,
+	// execute frames on a separate render thread, see tfx_render_frame.
+	TFX_RESET_RENDER_THREAD = 1 << 4,
+	// upload uniforms through uniform blocks in a persistently mapped buffer
+	// instead of glUniform*. needs GL 4.4 or ARB_buffer_storage, falls back if missing.
+	// uniform blocks are assigned binding points in declaration order.
+	TFX_RESET_UNIFORM_BUFFERS = 1 << 5
 	// TFX_RESET_VR
 } tfx_reset_flags;
 
@@ -103,7 +111,16 @@ typedef enum tfx_view_flags {
 	TFX_VIEW_NONE = 0,
 	TFX_VIEW_INVALIDATE = 1 << 0,
 	TFX_VIEW_FLUSH = 1 << 1,
+	// sort modes, only one may be set at a time. the mode is applied to draws
+	// as they are submitted, so set it before submitting to the view.
+	// draws execute in submission order.
 	TFX_VIEW_SORT_SEQUENTIAL = 1 << 2,
+	// reorder draws to minimize program, texture and state changes.
+	TFX_VIEW_SORT_STATE = 1 << 3,
+	// order by depth (see tfx_submit_ordered), lowest first.
+	TFX_VIEW_SORT_FRONT_TO_BACK = 1 << 4,
+	// order by depth (see tfx_submit_ordered), highest first.
+	TFX_VIEW_SORT_BACK_TO_FRONT = 1 << 5,
 	TFX_VIEW_DEFAULT = TFX_VIEW_SORT_SEQUENTIAL
 } tfx_view_flags;
 
@@ -184,6 +201,8 @@ typedef struct tfx_uniform {
 	int count;
 	int last_count;
 	size_t size;
+	// shared by all uniforms with the same name, assigned by tfx_uniform_new.
+	uint32_t id;
 } tfx_uniform;
 
 typedef struct tfx_texture {
@@ -200,6 +219,8 @@ typedef struct tfx_texture {
 	bool dirty;
 	uint16_t flags, _pad0;
 	void *internal;
+	// handle into the texture registry, stays invalid once freed.
+	uint32_t id;
 } tfx_texture;
 
 typedef struct tfx_canvas {
@@ -238,7 +259,9 @@ typedef struct tfx_vertex_component {
 typedef struct tfx_vertex_format {
 	// limit to 8, since we only have an 8 bit mask
 	tfx_vertex_component components[8];
-	uint8_t count, component_mask, _pad0[2];
+	uint8_t count, component_mask;
+	// for instance buffers, how many instances each element lasts (0 = 1)
+	uint8_t divisor, _pad0[1];
 	size_t stride;
 } tfx_vertex_format;
 
@@ -249,18 +272,30 @@ typedef struct tfx_buffer {
 	tfx_buffer_flags flags;
 	tfx_vertex_format format;
 	void *internal;
+	// handle into the buffer registry, stays invalid once freed.
+	uint32_t id;
+	// where the data lives in gl_id, only non-zero for suballocated buffers.
+	uint32_t offset;
+	uint32_t size;
 } tfx_buffer;
 
 typedef struct tfx_transient_buffer {
+	// without a format it holds indices, 32 bit ones if index_32 is set.
 	bool has_format;
+	bool index_32;
 	tfx_vertex_format format;
 	void *data;
-	uint16_t num;
+	uint32_t num;
 	uint32_t offset;
 } tfx_transient_buffer;
 
 typedef void (*tfx_draw_callback)(void);
 
+// records draws independently of other threads, see tfx_encoder_begin.
+typedef struct tfx_encoder tfx_encoder;
+// draws recorded once and submitted every frame, see tfx_bundle_begin.
+typedef struct tfx_bundle tfx_bundle;
+
 typedef struct tfx_timing_info {
 	uint64_t time;
 	uint8_t id, _pad0[3];
@@ -269,7 +304,26 @@ typedef struct tfx_timing_info {
 
 typedef struct tfx_stats {
 	uint32_t draws;
+	// GL draw calls made for them, fewer than draws when runs get batched into multi-draws.
+	uint32_t draw_calls;
 	uint32_t blits;
+	// uniform uploads made, and ones skipped because the program already had the value.
+	uint32_t uniforms;
+	uint32_t uniforms_skipped;
+	// GL state calls made, and ones skipped because the state was already set.
+	uint32_t state_changes;
+	uint32_t state_skipped;
+	// transient bytes used this frame, the most any frame has used, and
+	// allocations dropped because every chunk was full.
+	uint32_t transient_bytes;
+	uint32_t transient_peak;
+	uint32_t transient_dropped;
+	// times the CPU waited for the GPU to finish with a buffer before reusing it.
+	uint32_t fence_stalls;
+	// queued uploads issued this frame, their size, and how many are left for later frames.
+	uint32_t uploads;
+	uint32_t upload_bytes;
+	uint32_t uploads_pending;
 	uint32_t num_timings;
 	tfx_timing_info *timings;
 } tfx_stats;
@@ -285,6 +339,8 @@ typedef struct tfx_caps {
 	bool seamless_cubemap;
 	bool anisotropic_filtering;
 	bool multibind;
+	bool multi_draw_indirect;
+	bool draw_indirect;
 } tfx_caps;
 
 // TODO
@@ -312,17 +368,41 @@ TFX_API tfx_vertex_format tfx_vertex_format_start();
 TFX_API void tfx_vertex_format_add(tfx_vertex_format *fmt, uint8_t slot, size_t count, bool normalized, tfx_component_type type);
 TFX_API void tfx_vertex_format_end(tfx_vertex_format *fmt);
 TFX_API size_t tfx_vertex_format_offset(tfx_vertex_format *fmt, uint8_t slot);
+TFX_API void tfx_vertex_format_set_divisor(tfx_vertex_format *fmt, uint8_t divisor);
 
+// transient data lasts until the end of the frame. indices come from their own
+// buffer, pass a null format for 16 bit indices. frames needing more than one
+// buffer chain on more, when those run out too allocations come back with
+// num = 0. so do allocations bigger than a whole buffer. their data can still
+// be written, but it's never drawn (unless it's over 4GB, then it's NULL).
 TFX_API uint32_t tfx_transient_buffer_get_available(tfx_vertex_format *fmt);
 TFX_API tfx_transient_buffer tfx_transient_buffer_new(tfx_vertex_format *fmt, uint16_t num_verts);
+TFX_API tfx_transient_buffer tfx_transient_indices_new(uint32_t num_indices, bool index_32);
 
+// with TFX_BUFFER_SUBALLOCATE the buffer is a range of a shared GL buffer,
+// offsets given to the other functions stay relative to the buffer itself.
+// indirect commands still index the whole GL buffer, and instance buffers
+// can't be suballocated. falls back to a buffer of its own if unsupported.
 TFX_API tfx_buffer tfx_buffer_new(const void *data, size_t size, tfx_vertex_format *format, tfx_buffer_flags flags);
+// the data is copied, so it can be reused right away. any number of ranges can
+// be updated each frame, later updates win where they overlap.
 TFX_API void tfx_buffer_update(tfx_buffer *buf, const void *data, uint32_t offset, uint32_t size);
 TFX_API void tfx_buffer_free(tfx_buffer *buf);
 
 TFX_API tfx_texture tfx_texture_new(uint16_t w, uint16_t h, uint16_t layers, const void *data, tfx_format format, uint16_t flags);
 TFX_API void tfx_texture_update(tfx_texture *tex, const void *data);
 TFX_API void tfx_texture_free(tfx_texture *tex);
+
+// queue data to be uploaded while frames execute, from any thread. the data is
+// copied, and uploads are issued in order within the budget set by
+// tfx_set_upload_budget. each returns a ticket for tfx_upload_done, resources
+// created without data are the intended target. textures take whole 2D mips.
+TFX_API uint32_t tfx_buffer_upload(tfx_buffer *buf, const void *data, uint32_t offset, uint32_t size);
+TFX_API uint32_t tfx_texture_upload(tfx_texture *tex, uint16_t mip, const void *data, uint32_t size);
+// true once the upload has been issued, anything drawn after that sees it.
+TFX_API bool tfx_upload_done(uint32_t ticket);
+// 0 for no limit on either. by default 8MB and 2ms of uploads per frame.
+TFX_API void tfx_set_upload_budget(uint32_t bytes_per_frame, uint32_t usec_per_frame);
 TFX_API tfx_texture tfx_get_texture(tfx_canvas *canvas, uint8_t index);
 
 TFX_API tfx_canvas tfx_canvas_new(uint16_t w, uint16_t h, tfx_format format, uint16_t flags);
@@ -357,10 +437,13 @@ TFX_API tfx_program tfx_program_cs_len_new(const char *css, const int _cs_len);
 TFX_API tfx_program tfx_program_cs_new(const char *css);
 // TODO: add tfx_program_free(tfx_program). they are currently cleaned up with tfx_shutdown.
 
+// the name is copied. call from one thread at a time (i.e. while loading), and
+// create uniforms again after tfx_shutdown.
 TFX_API tfx_uniform tfx_uniform_new(const char *name, tfx_uniform_type type, int count);
 
 // TFX_API void tfx_set_transform(float *mtx, uint8_t count);
 TFX_API void tfx_set_transient_buffer(tfx_transient_buffer tb);
+TFX_API void tfx_set_transient_indices(tfx_transient_buffer tb);
 // pass -1 to update maximum uniform size
 TFX_API void tfx_set_uniform(tfx_uniform *uniform, const float *data, const int count);
 // pass -1 to update maximum uniform size
@@ -373,16 +456,96 @@ TFX_API void tfx_set_buffer(tfx_buffer *buf, uint8_t slot, bool write);
 TFX_API void tfx_set_image(tfx_uniform *uniform, tfx_texture *tex, uint8_t slot, uint8_t mip, bool write);
 TFX_API void tfx_set_vertices(tfx_buffer *vbo, int count);
 TFX_API void tfx_set_indices(tfx_buffer *ibo, int count, int offset);
+// draw count instances, multiplied by the view's instance multiplier.
+TFX_API void tfx_set_instances(int count);
+// per-instance attributes, read using the buffer's format. they take the
+// attribute locations following the vertex attributes. the buffer can't be
+// created with TFX_BUFFER_SUBALLOCATE.
+TFX_API void tfx_set_instance_buffer(tfx_buffer *buf);
 TFX_API void tfx_dispatch(uint8_t id, tfx_program program, uint32_t x, uint32_t y, uint32_t z);
-// TFX_API void tfx_submit_ordered(uint8_t id, tfx_program program, uint32_t depth, bool retain);
+// group counts come from a DispatchIndirectCommand in args at offset.
+TFX_API void tfx_dispatch_indirect(uint8_t id, tfx_program program, tfx_buffer *args, uint32_t offset);
+// depth is used as the sort key for depth sorted views, and as a tie breaker for state sorted views.
+TFX_API void tfx_submit_ordered(uint8_t id, tfx_program program, uint32_t depth, bool retain);
 TFX_API void tfx_submit(uint8_t id, tfx_program program, bool retain);
+TFX_API void tfx_submit_bundle(uint8_t id, tfx_bundle *bundle);
+// draw count tightly packed commands from args at offset, using the vertices
+// and indices set for the draw but ignoring their counts. the commands are
+// DrawElementsIndirectCommand with indices, DrawArraysIndirectCommand without.
+// if a compute job wrote args through tfx_set_buffer, it's synchronized for you.
+// instance counts come from the commands, the view instance multiplier doesn't apply.
+TFX_API void tfx_submit_indirect(uint8_t id, tfx_program program, tfx_buffer *args, uint32_t offset, uint32_t count);
 // submit an empty draw. useful for using draw callbacks and ensuring views are processed.
 TFX_API void tfx_touch(uint8_t id);
 
 TFX_API void tfx_blit(uint8_t src, uint8_t dst, uint16_t x, uint16_t y, uint16_t w, uint16_t h, int mip);
+// copy or clear buffer ranges on the GPU when view id executes, after its blits
+// and before its compute jobs. shader writes before them are synchronized for
+// you. clears fill with a 32 bit value, so offset and size must be multiples of 4.
+TFX_API void tfx_buffer_copy(uint8_t id, tfx_buffer *dst, uint32_t dst_offset, tfx_buffer *src, uint32_t src_offset, uint32_t size);
+TFX_API void tfx_buffer_clear(uint8_t id, tfx_buffer *buf, uint32_t offset, uint32_t size, uint32_t value);
+
+// encoders let several threads record draws for the same frame. each thread
+// begins its own slot (0 to TFX_ENCODER_MAX-1, 16 by default) and must end it
+// before tfx_frame. within a view, draws from the global functions come first,
+// followed by each slot in order, so the result doesn't depend on timing.
+// uniforms set on an encoder apply to everything it submits until tfx_frame.
+// view setup, blits, resource creation and updates stay on the main thread,
+// and view flags should be set before recording starts.
+TFX_API tfx_encoder *tfx_encoder_begin(uint8_t slot);
+TFX_API void tfx_encoder_end(tfx_encoder *enc);
+TFX_API void tfx_encoder_set_transient_buffer(tfx_encoder *enc, tfx_transient_buffer tb);
+TFX_API void tfx_encoder_set_transient_indices(tfx_encoder *enc, tfx_transient_buffer tb);
+TFX_API void tfx_encoder_set_uniform(tfx_encoder *enc, tfx_uniform *uniform, const float *data, const int count);
+TFX_API void tfx_encoder_set_uniform_int(tfx_encoder *enc, tfx_uniform *uniform, const int *data, const int count);
+TFX_API void tfx_encoder_set_callback(tfx_encoder *enc, tfx_draw_callback cb);
+TFX_API void tfx_encoder_set_state(tfx_encoder *enc, uint64_t flags);
+TFX_API void tfx_encoder_set_scissor(tfx_encoder *enc, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+TFX_API void tfx_encoder_set_texture(tfx_encoder *enc, tfx_uniform *uniform, tfx_texture *tex, uint8_t slot);
+TFX_API void tfx_encoder_set_buffer(tfx_encoder *enc, tfx_buffer *buf, uint8_t slot, bool write);
+TFX_API void tfx_encoder_set_image(tfx_encoder *enc, tfx_uniform *uniform, tfx_texture *tex, uint8_t slot, uint8_t mip, bool write);
+TFX_API void tfx_encoder_set_vertices(tfx_encoder *enc, tfx_buffer *vbo, int count);
+TFX_API void tfx_encoder_set_indices(tfx_encoder *enc, tfx_buffer *ibo, int count, int offset);
+TFX_API void tfx_encoder_set_instances(tfx_encoder *enc, int count);
+TFX_API void tfx_encoder_set_instance_buffer(tfx_encoder *enc, tfx_buffer *buf);
+TFX_API void tfx_encoder_dispatch(tfx_encoder *enc, uint8_t id, tfx_program program, uint32_t x, uint32_t y, uint32_t z);
+TFX_API void tfx_encoder_dispatch_indirect(tfx_encoder *enc, uint8_t id, tfx_program program, tfx_buffer *args, uint32_t offset);
+TFX_API void tfx_encoder_submit_ordered(tfx_encoder *enc, uint8_t id, tfx_program program, uint32_t depth, bool retain);
+TFX_API void tfx_encoder_submit(tfx_encoder *enc, uint8_t id, tfx_program program, bool retain);
+TFX_API void tfx_encoder_touch(tfx_encoder *enc, uint8_t id);
+TFX_API void tfx_encoder_submit_bundle(tfx_encoder *enc, uint8_t id, tfx_bundle *bundle);
+TFX_API void tfx_encoder_submit_indirect(tfx_encoder *enc, uint8_t id, tfx_program program, tfx_buffer *args, uint32_t offset, uint32_t count);
+
+// bundles record draws once, for things which don't change between frames.
+// record with the tfx_encoder_* functions on the returned encoder, the view
+// ids given while recording are ignored and the draws go wherever the bundle
+// is submitted, sorted with the rest of the view. transient buffers can't be
+// used. bundle draws get the current uniforms of whatever submits them, then
+// the ones set while recording. the recorded values are kept, so anything
+// which changes per frame (cameras and such) should be set before submitting.
+// a bundle may be submitted any number of times, to any views, until freed.
+// submitting and freeing happen on the thread calling tfx_frame.
+TFX_API tfx_encoder *tfx_bundle_begin();
+TFX_API tfx_bundle *tfx_bundle_end(tfx_encoder *enc);
+TFX_API void tfx_bundle_free(tfx_bundle *bundle);
 
 TFX_API tfx_stats tfx_frame();
 
+// with TFX_RESET_RENDER_THREAD, tfx_frame only hands the recorded frame over
+// and returns the stats of the previous one. a render thread which owns the GL
+// context runs the frames:
+//   tfx_reset(w, h, TFX_RESET_RENDER_THREAD); // then start the app thread
+//   while (tfx_render_frame()) { swap buffers }
+//   tfx_shutdown();
+// anything which creates, frees or otherwise needs GL (programs, buffers,
+// textures, canvases, tfx_reset) must happen on the render thread. data passed
+// to tfx_texture_update must stay valid until the tfx_frame after next
+// returns, since it's read while the next frame records.
+// blocks until a frame is ready and executes it. returns false after tfx_render_stop.
+TFX_API bool tfx_render_frame();
+// called from the app thread when it's done, releases the render thread.
+TFX_API void tfx_render_stop();
+
 #undef TFX_API
 
 #ifdef __cplusplus
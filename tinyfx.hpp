@@ -19,6 +19,9 @@ namespace tfx {
 		inline size_t offset(uint8_t slot) {
 			return tfx_vertex_format_offset(&this->fmt, slot);
 		}
+		inline void set_divisor(uint8_t divisor) {
+			tfx_vertex_format_set_divisor(&this->fmt, divisor);
+		}
 	};
 
 	struct Buffer {
@@ -36,6 +39,9 @@ namespace tfx {
 		TransientBuffer(VertexFormat &fmt, uint16_t num) {
 			tvb = tfx_transient_buffer_new(&fmt.fmt, num);
 		}
+		TransientBuffer(uint32_t num_indices, bool index_32 = false) {
+			tvb = tfx_transient_indices_new(num_indices, index_32);
+		}
 	};
 
 	struct Uniform {
@@ -103,6 +109,75 @@ namespace tfx {
 		}
 	};
 
+	// see tfx_encoder_begin, one per recording thread.
+	struct Encoder {
+		tfx_encoder *encoder;
+		Encoder(uint8_t slot) {
+			this->encoder = tfx_encoder_begin(slot);
+		}
+		inline void end() {
+			tfx_encoder_end(this->encoder);
+		}
+		inline void set_uniform(Uniform &uniform, float data) {
+			float tmp = data;
+			tfx_encoder_set_uniform(this->encoder, &uniform.uniform, &tmp, -1);
+		}
+		inline void set_uniform(Uniform &uniform, float *data) {
+			tfx_encoder_set_uniform(this->encoder, &uniform.uniform, data, -1);
+		}
+		inline void set_texture(Uniform &uniform, Texture &texture, uint8_t slot) {
+			tfx_encoder_set_texture(this->encoder, &uniform.uniform, &texture.texture, slot);
+		}
+		inline void set_callback(tfx_draw_callback cb) {
+			tfx_encoder_set_callback(this->encoder, cb);
+		}
+		inline void set_state(uint64_t flags) {
+			tfx_encoder_set_state(this->encoder, flags);
+		}
+		inline void set_buffer(Buffer &buf, uint8_t slot, bool write = false) {
+			tfx_encoder_set_buffer(this->encoder, &buf.buffer, slot, write);
+		}
+		inline void set_transient_buffer(TransientBuffer &tvb) {
+			tfx_encoder_set_transient_buffer(this->encoder, tvb.tvb);
+		}
+		inline void set_transient_indices(TransientBuffer &tib) {
+			tfx_encoder_set_transient_indices(this->encoder, tib.tvb);
+		}
+		inline void set_vertices(Buffer &vbo, int count = 0) {
+			tfx_encoder_set_vertices(this->encoder, &vbo.buffer, count);
+		}
+		inline void set_indices(Buffer &ibo, int count, int offset = 0) {
+			tfx_encoder_set_indices(this->encoder, &ibo.buffer, count, offset);
+		}
+		inline void set_instances(int count) {
+			tfx_encoder_set_instances(this->encoder, count);
+		}
+		inline void set_instance_buffer(Buffer &buf) {
+			tfx_encoder_set_instance_buffer(this->encoder, &buf.buffer);
+		}
+		inline void dispatch(View &view, Program &program, uint32_t x, uint32_t y, uint32_t z) {
+			tfx_encoder_dispatch(this->encoder, view.id, program.program, x, y, z);
+		}
+		inline void dispatch_indirect(View &view, Program &program, Buffer &args, uint32_t offset = 0) {
+			tfx_encoder_dispatch_indirect(this->encoder, view.id, program.program, &args.buffer, offset);
+		}
+		inline void submit(View &view, Program &program, bool retain = false) {
+			tfx_encoder_submit(this->encoder, view.id, program.program, retain);
+		}
+		inline void submit_ordered(View &view, Program &program, uint32_t depth, bool retain = false) {
+			tfx_encoder_submit_ordered(this->encoder, view.id, program.program, depth, retain);
+		}
+		inline void touch(View &view) {
+			tfx_encoder_touch(this->encoder, view.id);
+		}
+		inline void submit_bundle(View &view, tfx_bundle *bundle) {
+			tfx_encoder_submit_bundle(this->encoder, view.id, bundle);
+		}
+		inline void submit_indirect(View &view, Program &program, Buffer &args, uint32_t offset = 0, uint32_t count = 1) {
+			tfx_encoder_submit_indirect(this->encoder, view.id, program.program, &args.buffer, offset, count);
+		}
+	};
+
 	inline void dump_caps() {
 		tfx_dump_caps();
 	}
@@ -124,6 +199,12 @@ namespace tfx {
 	inline tfx_stats frame() {
 		return tfx_frame();
 	}
+	inline bool render_frame() {
+		return tfx_render_frame();
+	}
+	inline void render_stop() {
+		tfx_render_stop();
+	}
 	inline void set_uniform(Uniform &uniform, float data) {
 		float tmp = data;
 		tfx_set_uniform(&uniform.uniform, &tmp, -1);
@@ -146,27 +227,48 @@ namespace tfx {
 	inline void set_transient_buffer(TransientBuffer &tvb) {
 		tfx_set_transient_buffer(tvb.tvb);
 	}
+	inline void set_transient_indices(TransientBuffer &tib) {
+		tfx_set_transient_indices(tib.tvb);
+	}
 	inline void set_vertices(Buffer &vbo, int count = 0) {
 		tfx_set_vertices(&vbo.buffer, count);
 	}
 	inline void set_indices(Buffer &ibo, int count, int offset = 0) {
 		tfx_set_indices(&ibo.buffer, count, offset);
 	}
+	inline void set_instances(int count) {
+		tfx_set_instances(count);
+	}
+	inline void set_instance_buffer(Buffer &buf) {
+		tfx_set_instance_buffer(&buf.buffer);
+	}
 	inline void dispatch(uint8_t id, Program &program, uint32_t x, uint32_t y, uint32_t z) {
 		tfx_dispatch(id, program.program, x, y, z);
 	}
 	inline void dispatch(View &view, Program &program, uint32_t x, uint32_t y, uint32_t z) {
 		tfx_dispatch(view.id, program.program, x, y, z);
 	}
-	// inline void submit(uint8_t id, Program &program, uint32_t depth = 0, bool retain = false) {
-	// 	tfx_submit_ordered(id, program.program, depth, retain);
-	// }
+	inline void dispatch_indirect(View &view, Program &program, Buffer &args, uint32_t offset = 0) {
+		tfx_dispatch_indirect(view.id, program.program, &args.buffer, offset);
+	}
+	inline void submit_ordered(uint8_t id, Program &program, uint32_t depth, bool retain = false) {
+		tfx_submit_ordered(id, program.program, depth, retain);
+	}
+	inline void submit_ordered(View &view, Program &program, uint32_t depth, bool retain = false) {
+		tfx_submit_ordered(view.id, program.program, depth, retain);
+	}
 	inline void submit(uint8_t id, Program &program, bool retain = false) {
 		tfx_submit(id, program.program, retain);
 	}
 	inline void submit(View &view, Program &program, bool retain = false) {
 		tfx_submit(view.id, program.program, retain);
 	}
+	inline void submit_bundle(View &view, tfx_bundle *bundle) {
+		tfx_submit_bundle(view.id, bundle);
+	}
+	inline void submit_indirect(View &view, Program &program, Buffer &args, uint32_t offset = 0, uint32_t count = 1) {
+		tfx_submit_indirect(view.id, program.program, &args.buffer, offset, count);
+	}
 	// inline void blit(tfx_view *src, tfx_view *dst, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
 
 } // tfx